@@ -0,0 +1,93 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+// Scratch memory of one thread, handed out by bumping an offset and given back in stack order by Scope. Blocks are
+// kept once allocated, so once the first queries have grown the arena, later ones do not reach the heap.
+class Arena
+{
+public:
+	static const size_t kBlockSize = 1 << 20;
+
+	// gives back everything allocated since its construction
+	class Scope
+	{
+	public:
+		explicit Scope(Arena& arena) : mArena(arena), mBlock(arena.mBlock), mOffset(arena.mOffset) {}
+		~Scope() { mArena.mBlock = mBlock; mArena.mOffset = mOffset; }
+
+	private:
+		Scope(const Scope&);
+		Scope& operator=(const Scope&);
+
+		Arena& mArena;
+		size_t mBlock;
+		size_t mOffset;
+	};
+
+	Arena() : mBlock(0), mOffset(0) {}
+
+	// the arena of the current thread
+	static Arena& Local()
+	{
+		static thread_local Arena arena;
+		return arena;
+	}
+
+	// count value-initialized objects, never destroyed
+	template <typename T>
+	T* Allocate(size_t count)
+	{
+		static_assert(std::is_trivially_destructible<T>::value, "arena objects are not destroyed");
+		T* objects = static_cast<T*>(AllocateBytes(sizeof(T) * count, alignof(T)));
+		for (size_t k = 0; k < count; ++k)
+			new (objects + k) T();
+		return objects;
+	}
+
+private:
+	Arena(const Arena&);
+	Arena& operator=(const Arena&);
+
+	struct Block
+	{
+		std::unique_ptr<char[]> memory;
+		size_t size;
+	};
+
+	void* AllocateBytes(size_t size, size_t alignment)
+	{
+		assert(alignment <= alignof(std::max_align_t));
+		for (;; ++mBlock, mOffset = 0)
+		{
+			if (mBlock == mBlocks.size())
+			{
+				Block block;
+				block.size = (size > kBlockSize) ? size : kBlockSize;
+				block.memory.reset(new char[block.size]);
+				mBlocks.push_back(std::move(block));
+			}
+
+			const size_t offset = (mOffset + alignment - 1) & ~(alignment - 1);
+			if (offset + size <= mBlocks[mBlock].size)
+			{
+				mOffset = offset + size;
+				return mBlocks[mBlock].memory.get() + offset;
+			}
+		}
+	}
+
+	std::vector<Block> mBlocks;
+	// the block and offset of the next allocation
+	size_t mBlock;
+	size_t mOffset;
+};
+
+#endif //#ifndef ARENA_H
@@ -0,0 +1,78 @@
+#ifndef RANDOM_H
+#define RANDOM_H
+
+#include <cstdint>
+#include <array>
+
+// Philox4x32-10, a counter-based generator: every block of 4 outputs is a keyed bijection of its 128-bit counter,
+// so stream k of a seed is simply the counters with k in their upper half. Streams need no jump-ahead and any
+// number of them are independent; a job split into numbered parts gives the same numbers on any number of threads.
+// Only 32x32-bit multiplies, which are native on 32-bit targets as well.
+class Philox4x32
+{
+public:
+	typedef uint32_t result_type;
+
+	Philox4x32(uint64_t seed, uint64_t stream)
+		: mKey({{static_cast<uint32_t>(seed), static_cast<uint32_t>(seed >> 32)}})
+		, mStream(stream)
+		, mBlock(0)
+		, mIndex(kBlockSize)
+	{}
+
+	static constexpr result_type min() { return 0; }
+	static constexpr result_type max() { return UINT32_MAX; }
+
+	result_type operator()()
+	{
+		if (mIndex == kBlockSize)
+		{
+			mOutput = Block(mKey, mStream, mBlock++);
+			mIndex = 0;
+		}
+		return mOutput[mIndex++];
+	}
+
+	// uniform in [0, bound), bound must not be 0; the high half of a 64-bit product, rejecting the few low halves
+	// that would favor some results (Lemire), so there is no modulo bias and almost never a division
+	uint32_t Below(uint32_t bound)
+	{
+		uint64_t product = uint64_t((*this)()) * bound;
+		if (static_cast<uint32_t>(product) < bound)
+		{
+			const uint32_t threshold = (0 - bound) % bound;
+			while (static_cast<uint32_t>(product) < threshold)
+				product = uint64_t((*this)()) * bound;
+		}
+		return static_cast<uint32_t>(product >> 32);
+	}
+
+	// the 4 outputs of one counter
+	static std::array<uint32_t, 4> Block(const std::array<uint32_t, 2>& key, uint64_t stream, uint64_t block)
+	{
+		std::array<uint32_t, 4> counter = {{static_cast<uint32_t>(block), static_cast<uint32_t>(block >> 32),
+			static_cast<uint32_t>(stream), static_cast<uint32_t>(stream >> 32)}};
+		auto roundKey = key;
+		for (int round = 0; round < 10; ++round)
+		{
+			const uint64_t product0 = uint64_t(0xD2511F53) * counter[0];
+			const uint64_t product1 = uint64_t(0xCD9E8D57) * counter[2];
+			counter = {{static_cast<uint32_t>(product1 >> 32) ^ counter[1] ^ roundKey[0], static_cast<uint32_t>(product1),
+				static_cast<uint32_t>(product0 >> 32) ^ counter[3] ^ roundKey[1], static_cast<uint32_t>(product0)}};
+			roundKey[0] += 0x9E3779B9;
+			roundKey[1] += 0xBB67AE85;
+		}
+		return counter;
+	}
+
+private:
+	static const uint32_t kBlockSize = 4;
+
+	std::array<uint32_t, 2> mKey;
+	uint64_t mStream;
+	uint64_t mBlock;
+	std::array<uint32_t, 4> mOutput;
+	uint32_t mIndex;
+};
+
+#endif //#ifndef RANDOM_H
@@ -1,5 +1,7 @@
 #include "ThreadHelper.h"
 
+#include <vector>
+
 CThreadHelper::CThreadHelper()
 {
 }
@@ -26,28 +28,27 @@ void CThreadHelper::MultithreadedExecute( LPTHREAD_START_ROUTINE lpStartAddress,
 	if( nThreads == 0 )
 		nThreads = GetActiveProcessorCount( ALL_PROCESSOR_GROUPS );
 
-	auto t0 = GetTickCount();
-
-	auto* pHandles = new HANDLE[nThreads];
-	auto* pRoutines = new ROUTINE_WRAPPER_INFO[nThreads];
+	// a thread per routine rather than pool tasks: the routines may wait on each other, so all of them must run at once
+	std::vector<HANDLE> handles( nThreads );
+	std::vector<ROUTINE_WRAPPER_INFO> routines( nThreads );
 
 	for( DWORD kThread = 0; kThread < nThreads; kThread++ )
 	{
-		pRoutines[kThread].lpStartAddress = lpStartAddress;
-		pRoutines[kThread].lpParameter = lpParameter;
-		pRoutines[kThread].nThreadID = kThread;
+		routines[kThread].lpStartAddress = lpStartAddress;
+		routines[kThread].lpParameter = lpParameter;
+		routines[kThread].nThreadID = kThread;
 
-		pHandles[kThread] = CreateThread( NULL, 0, RoutineWrapper, reinterpret_cast<LPVOID>(&pRoutines[kThread]), 0, NULL );
-		if( pHandles[kThread] == NULL )
+		handles[kThread] = CreateThread( NULL, 0, RoutineWrapper, reinterpret_cast<LPVOID>(&routines[kThread]), 0, NULL );
+		if( handles[kThread] == NULL )
 		{
 			exit(-1);
 		}
 	}
 
-	WaitForMultipleObjects( nThreads, pHandles, TRUE, INFINITE );
-
-	delete[] pHandles;
-	delete[] pRoutines;
+	WaitForMultipleObjects( nThreads, handles.data(), TRUE, INFINITE );
 
-	//printf( "%d\n", GetTickCount() - t0 );
+	for( DWORD kThread = 0; kThread < nThreads; kThread++ )
+	{
+		CloseHandle( handles[kThread] );
+	}
 }
@@ -15,6 +15,8 @@ public:
 	CThreadHelper();
 	~CThreadHelper();
 
+	// Runs the routine on nThreads threads of its own, one per processor by default, and returns once all of them
+	// have. They all run at once, so they may wait on each other; work that does not should go to the ThreadPool.
 	void MultithreadedExecute( LPTHREAD_START_ROUTINE lpStartAddress, LPVOID lpParameter, DWORD nThreads = 0 );
 
 private:
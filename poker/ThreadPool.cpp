@@ -0,0 +1,147 @@
+#include "ThreadPool.h"
+
+// the pool and deque index of the current thread, when it is a worker
+static thread_local ThreadPool* tWorkerPool = nullptr;
+static thread_local uint32_t tWorkerIndex = 0;
+
+ThreadPool::ThreadPool(uint32_t numThreads)
+	: mNextWorker(0)
+	, mNumQueuedTasks(0)
+	, mStopping(false)
+{
+	if (numThreads == 0)
+		numThreads = std::thread::hardware_concurrency();
+	if (numThreads == 0)
+		numThreads = 1;
+
+	for (uint32_t index = 0; index < numThreads; ++index)
+	{
+		mWorkers.emplace_back(new Worker);
+	}
+	for (uint32_t index = 0; index < numThreads; ++index)
+	{
+		mWorkers[index]->thread = std::thread(&ThreadPool::WorkerLoop, this, index);
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lk(mSleepMutex);
+		mStopping = true;
+	}
+	mWakeUp.notify_all();
+
+	for (auto& worker : mWorkers)
+	{
+		worker->thread.join();
+	}
+}
+
+ThreadPool& ThreadPool::Get()
+{
+	static ThreadPool pool;
+	return pool;
+}
+
+void ThreadPool::Submit(TaskGroup& group, Task task)
+{
+	const uint32_t index = (tWorkerPool == this) ? tWorkerIndex : mNextWorker++ % NumThreads();
+	auto& worker = *mWorkers[index];
+	bool queued = false;
+	{
+		std::lock_guard<std::mutex> lk(worker.mutex);
+		if (worker.tail - worker.head < kQueueCapacity)
+		{
+			// counted before it can be taken, so the count never drops below 0
+			++mNumQueuedTasks;
+			group.mPending.fetch_add(1, std::memory_order_relaxed);
+			auto& slot = worker.tasks[worker.tail++ % kQueueCapacity];
+			slot.task = task;
+			slot.group = &group;
+			queued = true;
+		}
+	}
+	if (!queued)
+	{
+		task();
+		return;
+	}
+
+	// a thread going to sleep checks the count under mSleepMutex, so it is either seen or woken up
+	{
+		std::lock_guard<std::mutex> lk(mSleepMutex);
+	}
+	mWakeUp.notify_one();
+}
+
+void ThreadPool::Wait(TaskGroup& group)
+{
+	while (!group.Done())
+	{
+		if (RunTask())
+			continue;
+
+		// the group's last tasks run elsewhere: sleep until they are done or there is a task to help with
+		std::unique_lock<std::mutex> lk(mSleepMutex);
+		mWakeUp.wait(lk, [this, &group]() { return group.Done() || mNumQueuedTasks > 0; });
+	}
+}
+
+bool ThreadPool::RunTask()
+{
+	QueuedTask task = {};
+	const bool isWorker = tWorkerPool == this;
+	if (isWorker)
+	{
+		auto& worker = *mWorkers[tWorkerIndex];
+		std::lock_guard<std::mutex> lk(worker.mutex);
+		if (worker.head != worker.tail)
+		{
+			task = worker.tasks[--worker.tail % kQueueCapacity];
+		}
+	}
+
+	const uint32_t first = isWorker ? tWorkerIndex + 1 : 0;
+	for (uint32_t k = 0; !task.task && k < NumThreads(); ++k)
+	{
+		auto& victim = *mWorkers[(first + k) % NumThreads()];
+		std::lock_guard<std::mutex> lk(victim.mutex);
+		if (victim.head != victim.tail)
+		{
+			task = victim.tasks[victim.head++ % kQueueCapacity];
+		}
+	}
+
+	if (!task.task)
+		return false;
+
+	--mNumQueuedTasks;
+	task.task();
+	if (task.group->mPending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+	{
+		// wakes the threads waiting for the group
+		{
+			std::lock_guard<std::mutex> lk(mSleepMutex);
+		}
+		mWakeUp.notify_all();
+	}
+	return true;
+}
+
+void ThreadPool::WorkerLoop(uint32_t index)
+{
+	tWorkerPool = this;
+	tWorkerIndex = index;
+
+	for (;;)
+	{
+		if (RunTask())
+			continue;
+
+		std::unique_lock<std::mutex> lk(mSleepMutex);
+		mWakeUp.wait(lk, [this]() { return mStopping || mNumQueuedTasks > 0; });
+		if (mStopping && mNumQueuedTasks == 0)
+			return;
+	}
+}
@@ -0,0 +1,143 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// A persistent pool of worker threads, each with its own task deque. A worker runs its newest task first and, out
+// of work, steals the oldest task of another worker. Threads waiting for a TaskGroup run tasks meanwhile, so tasks
+// may submit and wait for tasks of their own, and sleep while only the group's running tasks are left. Tasks are
+// stored in place in fixed rings, so running them never allocates.
+class ThreadPool
+{
+public:
+	// a trivially copyable callable of up to kSize bytes
+	class Task
+	{
+	public:
+		static const size_t kSize = 64;
+
+		Task() : mInvoke(nullptr) {}
+
+		template <typename Function, typename = typename std::enable_if<!std::is_same<typename std::decay<Function>::type, Task>::value>::type>
+		Task(const Function& function)
+			: mInvoke(&Invoke<Function>)
+		{
+			static_assert(sizeof(Function) <= kSize && alignof(Function) <= alignof(Storage), "task too large to store in place");
+			static_assert(std::is_trivially_copyable<Function>::value, "tasks are copied bytewise");
+			new (&mStorage) Function(function);
+		}
+
+		explicit operator bool() const { return mInvoke != nullptr; }
+		void operator()() const { mInvoke(&mStorage); }
+
+	private:
+		typedef std::aligned_storage<kSize, alignof(std::max_align_t)>::type Storage;
+
+		template <typename Function>
+		static void Invoke(const void* storage) { (*static_cast<const Function*>(storage))(); }
+
+		Storage mStorage;
+		void (*mInvoke)(const void*);
+	};
+
+	// the outstanding tasks of one job
+	class TaskGroup
+	{
+	public:
+		TaskGroup() : mPending(0) {}
+		bool Done() const { return mPending.load(std::memory_order_acquire) == 0; }
+
+	private:
+		friend class ThreadPool;
+		std::atomic<uint32_t> mPending;
+	};
+
+	// one worker per hardware thread when numThreads is 0
+	explicit ThreadPool(uint32_t numThreads = 0);
+	~ThreadPool();
+
+	// the pool shared by the whole process
+	static ThreadPool& Get();
+
+	uint32_t NumThreads() const { return static_cast<uint32_t>(mWorkers.size()); }
+
+	// queued on the submitting worker's own deque, or spread over the workers from other threads; run right away
+	// when that deque is full
+	void Submit(TaskGroup& group, Task task);
+	void Wait(TaskGroup& group);
+
+	// calls body(begin, end) on disjoint ranges covering [0, count), none longer than grainSize; ranges are halved
+	// until they fit, one half left for other workers to steal
+	template <typename Body>
+	void ParallelFor(uint64_t count, uint64_t grainSize, const Body& body);
+
+private:
+	static const uint32_t kQueueCapacity = 1024;
+
+	struct QueuedTask
+	{
+		Task task;
+		TaskGroup* group;
+	};
+
+	struct Worker
+	{
+		Worker() : head(0), tail(0) {}
+
+		std::mutex mutex;
+		// tasks [head, tail) of a ring, the newest at the back
+		std::array<QueuedTask, kQueueCapacity> tasks;
+		uint32_t head;
+		uint32_t tail;
+		std::thread thread;
+	};
+
+	void WorkerLoop(uint32_t index);
+	// runs one task, the own newest or another worker's oldest; false when there was none
+	bool RunTask();
+
+	template <typename Body>
+	void SplitRange(TaskGroup& group, uint64_t begin, uint64_t end, uint64_t grainSize, const Body& body);
+
+	std::vector<std::unique_ptr<Worker>> mWorkers;
+	std::atomic<uint32_t> mNextWorker;
+	std::atomic<uint32_t> mNumQueuedTasks;
+	std::mutex mSleepMutex;
+	std::condition_variable mWakeUp;
+	bool mStopping;
+};
+
+template <typename Body>
+void ThreadPool::ParallelFor(uint64_t count, uint64_t grainSize, const Body& body)
+{
+	TaskGroup group;
+	SplitRange(group, 0, count, (grainSize > 0) ? grainSize : 1, body);
+	Wait(group);
+}
+
+template <typename Body>
+void ThreadPool::SplitRange(TaskGroup& group, uint64_t begin, uint64_t end, uint64_t grainSize, const Body& body)
+{
+	while (end - begin > grainSize)
+	{
+		const uint64_t middle = begin + (end - begin) / 2;
+		Submit(group, [this, &group, middle, end, grainSize, &body]() { SplitRange(group, middle, end, grainSize, body); });
+		end = middle;
+	}
+	if (begin < end)
+	{
+		body(begin, end);
+	}
+}
+
+#endif //#ifndef THREAD_POOL_H
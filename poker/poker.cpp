@@ -6,8 +6,11 @@
 #include "curses.h"
 
 #include "ThreadHelper.h"
+#include "ThreadPool.h"
+#include "Arena.h"
 #include "math.h"
 #include "Chronometer.h"
+#include "Random.h"
 
 #include <vector>
 #include <algorithm>
@@ -18,11 +21,221 @@
 #include <array>
 #include <limits>
 #include <tuple>
+#include <utility>
+#include <map>
+#include <atomic>
+#include <chrono>
+#include <new>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#include <immintrin.h>
+
+// functions using instruction sets above the compiler baseline; MSVC accepts the intrinsics anywhere
+#ifdef __GNUC__
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#define TARGET_SSE42 __attribute__((target("sse4.2,popcnt")))
+#define TARGET_BMI2 __attribute__((target("bmi2")))
+#else
+#define TARGET_AVX2
+#define TARGET_SSE42
+#define TARGET_BMI2
+#endif
 
 #define MIN(a,b) ( (a) < (b) ? (a) : (b) )
 #define MAX(a,b) ( (a) > (b) ? (a) : (b) )
 #define ABS(a) ( (a) > 0 ? (a) : -(a) )
 
+// COUNT_ALLOCATIONS: counts the heap allocations of the whole process, main then checks that repeated equity
+// queries make none
+//#define COUNT_ALLOCATIONS
+
+#ifdef COUNT_ALLOCATIONS
+static std::atomic<uint64_t> gNumAllocations(0);
+
+void* operator new(size_t size)
+{
+	gNumAllocations.fetch_add(1, std::memory_order_relaxed);
+	if (void* memory = malloc(size ? size : 1))
+		return memory;
+	throw std::bad_alloc();
+}
+
+void operator delete(void* memory) noexcept
+{
+	free(memory);
+}
+#endif
+
+inline uint_fast8_t PopCount(uint64_t v)
+{
+#if defined(_MSC_VER) && defined(_M_X64)
+	return static_cast<uint_fast8_t>(__popcnt64(v));
+#elif defined(_MSC_VER)
+	return static_cast<uint_fast8_t>(__popcnt(static_cast<uint32_t>(v)) + __popcnt(static_cast<uint32_t>(v >> 32)));
+#else
+	return static_cast<uint_fast8_t>(__builtin_popcountll(v));
+#endif
+}
+
+// index of the least significant set bit, v must not be 0
+inline uint_fast8_t LowestBit(uint64_t v)
+{
+#if defined(_MSC_VER) && defined(_M_X64)
+	unsigned long index;
+	_BitScanForward64(&index, v);
+	return static_cast<uint_fast8_t>(index);
+#elif defined(_MSC_VER)
+	unsigned long index;
+	if (_BitScanForward(&index, static_cast<uint32_t>(v)))
+		return static_cast<uint_fast8_t>(index);
+	_BitScanForward(&index, static_cast<uint32_t>(v >> 32));
+	return static_cast<uint_fast8_t>(index + 32);
+#else
+	return static_cast<uint_fast8_t>(__builtin_ctzll(v));
+#endif
+}
+
+// index of the most significant set bit, v must not be 0
+inline uint_fast8_t HighestBit(uint32_t v)
+{
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanReverse(&index, v);
+	return static_cast<uint_fast8_t>(index);
+#else
+	return static_cast<uint_fast8_t>(31 - __builtin_clz(v));
+#endif
+}
+
+// the bits above the most significant set bit of v, all of them when v is 0
+inline uint64_t BitsAbove(uint64_t v)
+{
+	v |= v >> 1;
+	v |= v >> 2;
+	v |= v >> 4;
+	v |= v >> 8;
+	v |= v >> 16;
+	v |= v >> 32;
+	return ~v;
+}
+
+// the next larger mask with as many set bits as v (Gosper's hack), v must not be 0
+inline uint64_t NextSubsetMask(uint64_t v)
+{
+	const uint64_t ripple = v + (v & (0 - v));
+	return ripple | (((v ^ ripple) >> 2) >> LowestBit(v));
+}
+
+inline bool DetectBmi2()
+{
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7)
+		return false;
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 8)) != 0;
+#else
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("bmi2");
+#endif
+}
+
+// bit k of bits moved to the k-th lowest set bit of mask
+TARGET_BMI2 inline uint64_t DepositBitsBmi2(uint64_t bits, uint64_t mask)
+{
+#if defined(_M_X64) || defined(__x86_64__)
+	return _pdep_u64(bits, mask);
+#else
+	const auto lowMask = static_cast<uint32_t>(mask);
+	const uint64_t low = _pdep_u32(static_cast<uint32_t>(bits), lowMask);
+	const uint64_t high = _pdep_u32(static_cast<uint32_t>(bits >> PopCount(lowMask)), static_cast<uint32_t>(mask >> 32));
+	return low | (high << 32);
+#endif
+}
+
+// the same, walking mask up to the highest set bit of bits
+inline uint64_t DepositBitsPortable(uint64_t bits, uint64_t mask)
+{
+	uint64_t result = 0;
+	uint_fast8_t skipped = 0;
+	for (; bits != 0; bits &= bits - 1)
+	{
+		for (const auto index = LowestBit(bits); skipped < index; ++skipped)
+			mask &= mask - 1;
+		result |= mask & (0 - mask);
+	}
+	return result;
+}
+
+inline uint64_t DepositBits(uint64_t bits, uint64_t mask)
+{
+	static const bool hasBmi2 = DetectBmi2();
+	return hasBmi2 ? DepositBitsBmi2(bits, mask) : DepositBitsPortable(bits, mask);
+}
+
+constexpr uintmax_t CombinationNum(uint32_t n, uint32_t k)
+{
+	return (k == 0) ? 1 : (n > k) ? n * CombinationNum(n - 1, k - 1) : 1;
+}
+
+constexpr uintmax_t Factorial(uint32_t n)
+{
+	return n <= 1 ? 1 : (n * Factorial(n - 1));
+}
+
+constexpr uintmax_t Combination(uint32_t n, uint32_t k)
+{
+	return (n - k < k) ? CombinationNum(n, n - k) / Factorial(n - k) : CombinationNum(n, k) / Factorial(k);
+}
+
+// a subset of size of the numOptions lowest bits, the subsets ranked in increasing order of their masks, the order
+// NextSubsetMask walks them
+inline uint64_t UnrankSubset(uintmax_t rank, uint_fast8_t size, uint_fast8_t numOptions)
+{
+	uint64_t subset = 0;
+	uint_fast8_t element = numOptions;
+	for (auto k = size; k > 0; --k)
+	{
+		// the largest element with at most rank k-subsets below it
+		uintmax_t count;
+		do {
+			--element;
+			count = (element >= k) ? Combination(element, k) : 0;
+		} while (count > rank);
+		rank -= count;
+		subset |= uint64_t(1) << element;
+	}
+	return subset;
+}
+
+// calls visitor with the subsets of mask having the given size ranked [begin, end) as in UnrankSubset: the first one
+// is unranked, the others stepped to
+template <typename Visitor>
+void ForEachSubsetInRange(uint64_t mask, uint_fast8_t size, uintmax_t begin, uintmax_t end, Visitor& visitor)
+{
+	uint64_t subset = UnrankSubset(begin, size, PopCount(mask));
+	for (auto rank = begin; rank < end; ++rank)
+	{
+		if (rank != begin)
+			subset = NextSubsetMask(subset);
+		visitor(DepositBits(subset, mask));
+	}
+}
+
+// the subsets of mask having the given size cut into ranges of ranks for a few pool tasks per thread; each task
+// calls body(begin, end), which walks its range with ForEachSubsetInRange
+template <typename Body>
+void ParallelForEachSubset(uint64_t mask, uint_fast8_t size, const Body& body)
+{
+	auto& pool = ThreadPool::Get();
+	const uintmax_t numSubsets = Combination(PopCount(mask), size);
+	const uintmax_t numRanges = (pool.NumThreads() + 1) * 4;
+	pool.ParallelFor(numSubsets, (numSubsets + numRanges - 1) / numRanges, body);
+}
+
 enum class CardValue : uint8_t
 {
 	Deuce = 0,
@@ -188,6 +401,150 @@ std::string ToString(const Card* cards, int numCards, bool reverse = true)
 	return s;
 }
 
+// A set of cards as a 52-bit mask, 13 value bits per color
+struct CardSet
+{
+	static constexpr uint_fast8_t kColorShift = static_cast<uint_fast8_t>(CardValue::Count);
+	static constexpr uint_fast16_t kColorMask = (1 << kColorShift) - 1;
+
+	CardSet() : mask(0) {}
+	explicit CardSet(uint64_t m) : mask(m) {}
+	CardSet(const Card* cards, size_t numCards) : mask(0)
+	{
+		for (size_t k = 0; k < numCards; ++k)
+			mask |= Bit(cards[k]);
+	}
+
+	static uint64_t Bit(const Card c)
+	{
+		return uint64_t(1) << (static_cast<uint_fast8_t>(c.color) * kColorShift + static_cast<uint_fast8_t>(c.value));
+	}
+	static Card BitCard(uint_fast8_t bit)
+	{
+		return Card(static_cast<uint8_t>((bit % kColorShift) << 2 | (bit / kColorShift)));
+	}
+
+	CardSet& operator|=(const Card c) { mask |= Bit(c); return *this; }
+	CardSet& operator|=(const CardSet cs) { mask |= cs.mask; return *this; }
+	const CardSet operator|(const Card c) const { return CardSet(*this) |= c; }
+	const CardSet operator|(const CardSet cs) const { return CardSet(*this) |= cs; }
+	bool operator==(const CardSet cs) const { return mask == cs.mask; }
+
+	bool Contains(const Card c) const { return (mask & Bit(c)) != 0; }
+	bool Intersects(const CardSet cs) const { return (mask & cs.mask) != 0; }
+	uint_fast8_t Size() const { return PopCount(mask); }
+	uint_fast16_t SuitMask(CardColor color) const
+	{
+		return static_cast<uint_fast16_t>(mask >> (static_cast<uint_fast8_t>(color) * kColorShift)) & kColorMask;
+	}
+
+	uint64_t mask;
+};
+
+// Deals random cards out of a set of live ones by a partial Fisher-Yates shuffle of their bits: each deal swaps a
+// random card not dealt yet into place, so nothing is redrawn. Reset makes all of them live again, in the order the
+// earlier deals left them, which is as random a start as any.
+class CardDealer
+{
+public:
+	static const uint_fast8_t kNumCards = CardSet::kColorShift * static_cast<uint_fast8_t>(CardColor::Count);
+
+	CardDealer() : mNumLiveCards(0), mNumDealt(0) {}
+	explicit CardDealer(const CardSet liveCards) : mNumLiveCards(0), mNumDealt(0)
+	{
+		for (auto cards = liveCards.mask; cards != 0; cards &= cards - 1)
+			mBits[mNumLiveCards++] = LowestBit(cards);
+	}
+
+	uint_fast8_t NumLiveCards() const { return mNumLiveCards - mNumDealt; }
+	void Reset() { mNumDealt = 0; }
+
+	template <typename Random>
+	uint_fast8_t DealBit(Random& random)
+	{
+		assert(mNumDealt < mNumLiveCards);
+		const auto k = mNumDealt + random.Below(mNumLiveCards - mNumDealt);
+		std::swap(mBits[mNumDealt], mBits[k]);
+		return mBits[mNumDealt++];
+	}
+
+	template <typename Random>
+	CardSet Deal(Random& random, uint_fast8_t numCards)
+	{
+		CardSet cards;
+		for (uint_fast8_t k = 0; k < numCards; ++k)
+			cards.mask |= uint64_t(1) << DealBit(random);
+		return cards;
+	}
+
+private:
+	std::array<uint8_t, kNumCards> mBits;
+	uint_fast8_t mNumLiveCards;
+	uint_fast8_t mNumDealt;
+};
+
+// A group of suit permutations. Starts as all 24 of them and narrows down to the ones leaving given card sets
+// unchanged; the sets such a group maps onto each other rank the same, so only the smallest mask of each orbit
+// needs evaluating, counted as many times as the orbit has members.
+class SuitSymmetry
+{
+public:
+	static constexpr uint_fast8_t kNumColors = static_cast<uint_fast8_t>(CardColor::Count);
+	typedef std::array<uint8_t, kNumColors> Permutation;
+
+	SuitSymmetry() : mNumPermutations(0)
+	{
+		Permutation permutation = {0, 1, 2, 3};
+		do {
+			mPermutations[mNumPermutations++] = permutation;
+		} while (std::next_permutation(permutation.begin(), permutation.end()));
+	}
+
+	static CardSet Apply(const CardSet cards, const Permutation& permutation)
+	{
+		CardSet result;
+		for (uint_fast8_t color = 0; color < kNumColors; ++color)
+		{
+			result.mask |= uint64_t(cards.SuitMask(static_cast<CardColor>(color))) << (permutation[color] * CardSet::kColorShift);
+		}
+		return result;
+	}
+
+	SuitSymmetry Stabilizer(const CardSet cards) const
+	{
+		SuitSymmetry result(*this);
+		result.mNumPermutations = 0;
+		for (uint_fast8_t k = 0; k < mNumPermutations; ++k)
+		{
+			if (Apply(cards, mPermutations[k]) == cards)
+				result.mPermutations[result.mNumPermutations++] = mPermutations[k];
+		}
+		return result;
+	}
+
+	// the orbit size of cards, or 0 when another member of the orbit has a smaller mask
+	uint_fast32_t OrbitWeight(const CardSet cards) const
+	{
+		uint_fast32_t numStabilizers = 0;
+		for (uint_fast8_t k = 0; k < mNumPermutations; ++k)
+		{
+			const auto image = Apply(cards, mPermutations[k]);
+			if (image.mask < cards.mask)
+				return 0;
+			numStabilizers += (image == cards) ? 1 : 0;
+		}
+		return mNumPermutations / numStabilizers;
+	}
+
+	bool IsTrivial() const { return mNumPermutations == 1; }
+	const Permutation* begin() const { return mPermutations.data(); }
+	const Permutation* end() const { return mPermutations.data() + mNumPermutations; }
+
+private:
+	std::array<Permutation, 24> mPermutations;
+	uint_fast8_t mNumPermutations;
+};
+
 std::string ToString(HandType type)
 {
 	switch (type)
@@ -723,408 +1080,1046 @@ int CompareHands(const Card hand1[5], const Card hand2[5])
 	}
 }
 
-void sortCards( byte cards[5] )
+// Strength of a hand as a single integer: the HandType sits in the top 4 bits and a dense index of the hand
+// within its type in the low 12 bits, so a stronger hand always has a greater rank.
+typedef uint16_t HandRank;
+
+constexpr HandRank MakeHandRank(HandType type, uint_fast16_t index)
 {
-	byte temp;
-	for( byte i = 0; i < 4; i++ )
-		for( byte j = i+1; j < 5; j++ )
-			if( cards[i] > cards[j] ){
-				temp = cards[i];
-				cards[i] = cards[j];
-				cards[j] = temp;
-			}
+	return static_cast<HandRank>((static_cast<uint_fast16_t>(type) << 12) | index);
 }
 
-void PrintSymbol( char* str, byte card )
+inline HandType GetHandType(HandRank rank)
 {
-	byte val = card >> 2;
-	char cval = val + 2;
+	return static_cast<HandType>(rank >> 12);
+}
 
-	str[0] = ' ';
+// Lookup tables behind GetHandRank.
+// Every card adds a per-value weight to a rank key; the weights are chosen so that any multiset of 7 values
+// has a distinct sum, which makes the key a perfect hash of the non-flush part of the hand. Flushes are rare and
+// are resolved by a second table indexed by the 13-bit value mask of the flush suit.
+class HandRankTables
+{
+public:
+	static constexpr uint_fast32_t kMaxKey = 4 * 1479181 + 3 * 636345;
+	static constexpr uint_fast32_t kSuitCountBias = 0x3333; // a suit nibble reaches 8 once it holds 5 cards
+	static constexpr uint_fast32_t kFlushCheckMask = 0x8888;
 
-	if( val < 8 )
-		str[1] = '0' + cval;
-	else if( val == 8 ){
-		str[0] = '1';
-		str[1] = '0';
+	static const uint_fast32_t kValueKeys[static_cast<int32_t>(CardValue::Count)];
+
+	static const HandRankTables& Get()
+	{
+		static const HandRankTables tables;
+		return tables;
 	}
-	else
+
+	HandRank NonFlushRank(uint_fast32_t rankKey) const { return mNonFlushRanks[rankKey]; }
+	HandRank FlushRank(uint_fast16_t valueMask) const { return mFlushRanks[valueMask]; }
+	// rank key contribution of all the values of a 13-bit mask
+	uint32_t SuitKey(uint_fast16_t valueMask) const { return mSuitKeys[valueMask]; }
+
+	// raw tables for the SIMD kernels, the rank tables are padded so a 32-bit gather may start at any entry
+	const uint32_t* SuitKeys() const { return mSuitKeys.data(); }
+	const HandRank* NonFlushRanks() const { return mNonFlushRanks.data(); }
+	const HandRank* FlushRanks() const { return mFlushRanks.data(); }
+
+	// best 5-card rank of a hand given as the masks of the values it holds at least once, twice, three and
+	// four times, ignoring flushes
+	HandRank RankValueMasks(uint_fast16_t values, uint_fast16_t pairs, uint_fast16_t trips, uint_fast16_t quads) const;
+	// best 5-card rank of a hand given as a mask of values which all belong to one suit (at least 5 bits set)
+	HandRank RankFlush(uint_fast16_t valueMask) const;
+
+	// bit i is set for every straight topped by value Five + i
+	static uint_fast16_t GetStraights(uint_fast16_t valueMask)
 	{
-		switch( val ){
-			case  9: str[1] = 'J'; break;
-			case 10: str[1] = 'Q'; break;
-			case 11: str[1] = 'K'; break;
-			case 12: str[1] = 'A'; break;
-		}
+		const uint_fast16_t lowAce = (valueMask << 1) | (valueMask >> static_cast<uint_fast8_t>(CardValue::Ace));
+		return lowAce & (lowAce >> 1) & (lowAce >> 2) & (lowAce >> 3) & (lowAce >> 4);
 	}
 
-	switch( card & 3 ){
-		case 0: str[2] = 's'; break;
-		case 1: str[2] = 'h'; break;
-		case 2: str[2] = 'd'; break;
-		case 3: str[2] = 'c'; break;
+private:
+	HandRankTables();
+
+	static uint_fast16_t KeepHighest(uint_fast16_t valueMask, uint_fast8_t numBits)
+	{
+		while (PopCount(valueMask) > numBits)
+			valueMask &= valueMask - 1;
+		return valueMask;
 	}
-}
 
-void PrintHand( char* str, byte cards[5] )
-{
-	PrintSymbol( str, cards[0] );
-	str[3] = ' ';
-	PrintSymbol( str + 4, cards[1] );
-	str[7] = ' ';
-	PrintSymbol( str + 8, cards[2] );
-	str[11] = ' ';
-	PrintSymbol( str + 12, cards[3] );
-	str[15] = ' ';
-	PrintSymbol( str + 16, cards[4] );
-}
+	std::vector<HandRank> mNonFlushRanks;
+	std::array<HandRank, (1 << 13) + 1> mFlushRanks;
+	std::array<uint32_t, 1 << 13> mSuitKeys;
+	std::array<uint16_t, 1 << 13> mHighCardIndices;
+	std::array<std::array<uint16_t, 4>, 14> mBinomials;
+};
 
-void SaveAllHandsToFile()
+const uint_fast32_t HandRankTables::kValueKeys[static_cast<int32_t>(CardValue::Count)] =
 {
-	byte cards[5];
-	HandType ht;
-	int kHand = 0;
-	//char sHand[19];
-	int stats[9];
-
-	memset( stats, 0, 9 * sizeof(int) );
+	0, 1, 5, 22, 98, 453, 2031, 8698, 22854, 83661, 262349, 636345, 1479181
+};
 
-	//FILE *f;
-	//fopen_s( &f, "C:\\poker.txt", "wt" );
+HandRankTables::HandRankTables()
+	: mNonFlushRanks(kMaxKey + 2)
+{
+	// Pascal's triangle, C(n, k) = 0 for k > n
+	for (uint_fast16_t n = 0; n < mBinomials.size(); ++n)
+	{
+		mBinomials[n][0] = 1;
+		for (uint_fast16_t k = 1; k < mBinomials[n].size(); ++k)
+		{
+			mBinomials[n][k] = (n == 0) ? 0 : mBinomials[n - 1][k - 1] + mBinomials[n - 1][k];
+		}
+	}
 
-	for( byte k0 = 0; k0 < 48; k0++ )
+	// 5 distinct values are ordered like their masks, so numbering the non straight masks in increasing order
+	// gives the dense index used by both HighCard and Flush; larger masks share the index of their top 5 values
+	uint16_t highCardIndex = 0;
+	for (uint_fast16_t mask = 0; mask < mHighCardIndices.size(); ++mask)
 	{
-		cards[0] = k0;
-		for( byte k1 = k0+1; k1 < 49; k1++ )
+		mHighCardIndices[mask] = 0;
+		if (PopCount(mask) == 5 && GetStraights(mask) == 0)
 		{
-			cards[1] = k1;
-			for( byte k2 = k1+1; k2 < 50; k2++ )
-			{
-				cards[2] = k2;
-				for( byte k3 = k2+1; k3 < 51; k3++ )
-				{
-					cards[3] = k3;
-					for( byte k4 = k3+1; k4 < 52; k4++ )
-					{
-						cards[4] = k4;
-						ht = GetHandType( cards );
-						stats[(int)ht]++;
-						//PrintHand( sHand, cards );
-						//fprintf( f, "%.7i %s   %s\n", kHand++, sHand, g_den[ht] );
-					}
-				}
-			}
+			mHighCardIndices[mask] = highCardIndex++;
+		}
+		else if (PopCount(mask) > 5)
+		{
+			mHighCardIndices[mask] = mHighCardIndices[KeepHighest(mask, 5)];
 		}
 	}
 
-	for( byte i = 0; i < 9; i++ )
-		printf( "%d %d\n", i, stats[i] );
+	for (uint_fast16_t mask = 0; mask < mSuitKeys.size(); ++mask)
+	{
+		mFlushRanks[mask] = (PopCount(mask) >= 5) ? RankFlush(mask) : 0;
+		mSuitKeys[mask] = 0;
+		for (int32_t v = 0; v < static_cast<int32_t>(CardValue::Count); ++v)
+		{
+			if (mask & (1 << v))
+				mSuitKeys[mask] += kValueKeys[v];
+		}
+	}
+	mFlushRanks.back() = 0;
 
-	char x;
-	scanf_s("%c", &x, 1);
+	// walk every value multiset of 7 cards (smaller multisets may share keys with them)
+	constexpr int32_t numValues = static_cast<int32_t>(CardValue::Count);
+	std::array<uint8_t, numValues> counts = {};
+	for (;;)
+	{
+		int32_t numCards = 0;
+		uint_fast32_t rankKey = 0;
+		uint_fast16_t masks[4] = { 0, 0, 0, 0 };
+		for (int32_t v = 0; v < numValues; ++v)
+		{
+			numCards += counts[v];
+			rankKey += counts[v] * kValueKeys[v];
+			for (uint8_t c = 0; c < counts[v]; ++c)
+				masks[c] |= 1 << v;
+		}
+		if (numCards == 7)
+		{
+			mNonFlushRanks[rankKey] = RankValueMasks(masks[0], masks[1], masks[2], masks[3]);
+		}
 
-	//fclose( f );
+		int32_t v = 0;
+		while (v < numValues && (counts[v] == 4 || numCards >= 7))
+		{
+			numCards -= counts[v];
+			counts[v++] = 0;
+		}
+		if (v == numValues)
+			break;
+		++counts[v];
+	}
 }
 
-byte DealCard( byte cardsDealt[], byte nCardsDealt )
+inline HandRank HandRankTables::RankValueMasks(uint_fast16_t values, uint_fast16_t pairs, uint_fast16_t trips, uint_fast16_t quads) const
 {
-	byte card, i;
-	while( 1 ){
-		card = rand() % 52;
-		for( i = 0; i < nCardsDealt; i++ )
-			if( card == cardsDealt[i] )
-				break;
-		if( i == nCardsDealt ){
-			cardsDealt[nCardsDealt] = card;
-			return card;
-		}
+	// index of a value among the values left once the excluded ones are taken out
+	auto skip = [](uint_fast8_t v, uint_fast16_t excluded) {
+		return static_cast<uint_fast16_t>(v - PopCount(excluded & ((1 << v) - 1)));
+	};
+
+	if (quads)
+	{
+		const auto q = HighestBit(quads);
+		const auto k = HighestBit(values & ~(1 << q));
+		return MakeHandRank(HandType::FourOfAKind, q * 12 + skip(k, 1 << q));
 	}
-	return 0;
+	if (trips)
+	{
+		// a second set of trips plays as the pair
+		const auto t = HighestBit(trips);
+		const auto fullHousePairs = pairs & ~(1 << t);
+		if (fullHousePairs)
+			return MakeHandRank(HandType::FullHouse, t * 12 + skip(HighestBit(fullHousePairs), 1 << t));
+	}
+	const auto straights = GetStraights(values);
+	if (straights)
+	{
+		return MakeHandRank(HandType::Straight, HighestBit(straights));
+	}
+	if (trips)
+	{
+		const auto t = HighestBit(trips);
+		const auto kickers = values & ~(1 << t);
+		const auto k1 = HighestBit(kickers);
+		const auto k2 = HighestBit(kickers & ~(1 << k1));
+		return MakeHandRank(HandType::ThreeOfAKind, t * 66 + mBinomials[skip(k1, 1 << t)][2] + skip(k2, 1 << t));
+	}
+	if (pairs)
+	{
+		const auto p1 = HighestBit(pairs);
+		const auto lowerPairs = pairs & ~(1 << p1);
+		if (lowerPairs)
+		{
+			const auto p2 = HighestBit(lowerPairs);
+			const uint_fast16_t excluded = (1 << p1) | (1 << p2);
+			const auto k = HighestBit(values & ~excluded);
+			return MakeHandRank(HandType::TwoPair, (mBinomials[p1][2] + p2) * 11 + skip(k, excluded));
+		}
+		const auto kickers = values & ~(1 << p1);
+		const auto k1 = HighestBit(kickers);
+		const auto k2 = HighestBit(kickers & ~(1 << k1));
+		const auto k3 = HighestBit(kickers & ~(1 << k1) & ~(1 << k2));
+		return MakeHandRank(HandType::OnePair, p1 * 220
+			+ mBinomials[skip(k1, 1 << p1)][3] + mBinomials[skip(k2, 1 << p1)][2] + skip(k3, 1 << p1));
+	}
+	return MakeHandRank(HandType::HighCard, mHighCardIndices[values]);
 }
 
-void GetBestHand( byte cards[], byte nCards, byte bestHand[] )
+HandRank HandRankTables::RankFlush(uint_fast16_t valueMask) const
 {
-	byte idx[5] = { 0, 1, 2, 3, 4 };
-	bestHand[0] = cards[idx[0]];
-	bestHand[1] = cards[idx[1]];
-	bestHand[2] = cards[idx[2]];
-	bestHand[3] = cards[idx[3]];
-	bestHand[4] = cards[idx[4]];
-	sortCards( bestHand );
-	byte newHand[5];
-	while( idx[0] < nCards - 5 )
+	const auto straights = GetStraights(valueMask);
+	if (straights)
+		return MakeHandRank(HandType::StraightFlush, HighestBit(straights));
+	return MakeHandRank(HandType::Flush, mHighCardIndices[valueMask]);
+}
+
+// Ranks the best 5-card hand among 7 cards in one table lookup (two for flushes), no sorting needed.
+template <uint_fast8_t NumDeckCards>
+HandRank GetHandRank(const std::array<Card, NumDeckCards>& cards)
+{
+	static_assert(NumDeckCards == 7, "the rank key is a perfect hash for 7 cards only");
+
+	const auto& tables = HandRankTables::Get();
+
+	uint_fast32_t rankKey = 0;
+	uint_fast32_t suitCounts = HandRankTables::kSuitCountBias;
+	for (const auto card : cards)
 	{
-		for( byte i = 4; i >= 0; i-- )
-			if( idx[i] < nCards - 5 + i ){
-				idx[i]++;
-				for( byte j = i+1; j < 5; j++ )
-					idx[j] = idx[j-1] + 1;
-				break;
-			}
-		newHand[0] = cards[idx[0]];
-		newHand[1] = cards[idx[1]];
-		newHand[2] = cards[idx[2]];
-		newHand[3] = cards[idx[3]];
-		newHand[4] = cards[idx[4]];
-		sortCards( newHand );
+		rankKey += HandRankTables::kValueKeys[static_cast<uint_fast8_t>(card.value)];
+		suitCounts += 1 << (static_cast<uint_fast8_t>(card.color) << 2);
+	}
 
-		if( CompareHands( bestHand, newHand ) == -1 ){
-			bestHand[0] = newHand[0];
-			bestHand[1] = newHand[1];
-			bestHand[2] = newHand[2];
-			bestHand[3] = newHand[3];
-			bestHand[4] = newHand[4];
-		}
+	const auto flushCheck = suitCounts & HandRankTables::kFlushCheckMask;
+	if (flushCheck == 0)
+		return tables.NonFlushRank(rankKey);
+
+	// with 7 cards a flush beats anything the other suits could make
+	uint_fast8_t flushColor = 0;
+	while ((flushCheck >> (flushColor << 2)) != 8)
+		++flushColor;
+	uint_fast16_t valueMask = 0;
+	for (const auto card : cards)
+	{
+		if (static_cast<uint_fast8_t>(card.color) == flushColor)
+			valueMask |= 1 << static_cast<uint_fast8_t>(card.value);
 	}
+	return tables.FlushRank(valueMask);
 }
 
-void DecideBeforeDeal()
+// Ranks the best 5-card hand among 5 to 7 cards straight from their suit masks, no sorting or tables beyond
+// the 13-bit flush and high card ones.
+inline HandRank GetHandRank(CardSet cards)
 {
-
+	const auto& tables = HandRankTables::Get();
+
+	const auto s = cards.SuitMask(CardColor::Spade);
+	const auto h = cards.SuitMask(CardColor::Heart);
+	const auto d = cards.SuitMask(CardColor::Diamond);
+	const auto c = cards.SuitMask(CardColor::Club);
+
+	// with 7 cards or less a flush beats anything the other suits could make
+	if (PopCount(s) >= 5)
+		return tables.FlushRank(s);
+	if (PopCount(h) >= 5)
+		return tables.FlushRank(h);
+	if (PopCount(d) >= 5)
+		return tables.FlushRank(d);
+	if (PopCount(c) >= 5)
+		return tables.FlushRank(c);
+
+	const auto values = s | h | d | c;
+	const auto pairs = (s & h) | (d & c) | ((s | h) & (d | c));
+	const auto trips = ((s & h) & (d | c)) | ((d & c) & (s | h));
+	const auto quads = s & h & d & c;
+	return tables.RankValueMasks(values, pairs, trips, quads);
 }
 
-void DecideAfterFlop( byte hand[], byte table[], float& fWin, float& fDraw )
+// Evaluator state of a partial hand. Adding a card costs two additions, so a prefix shared by many
+// runouts (the flop and turn under every river, or the board under every pair of hole cards) is built once
+// and only the cards that change are paid for.
+struct HandState
 {
-	byte otherHand[2];
-	byte bestHand1[5];
-	byte bestHand2[5];
-	byte cards[7];
-	cards[2] = table[0];
-	cards[3] = table[1];
-	cards[4] = table[2];
-	int nTotalHands = 0;
-	int nWonHands = 0;
-	int nDrawHands = 0;
-	for( byte k0 = 0; k0 < 51; k0++ )
+	HandState() : rankKey(0), suitCounts(HandRankTables::kSuitCountBias), numCards(0) {}
+	explicit HandState(CardSet cs)
+		: cards(cs)
+		, rankKey(0)
+		, suitCounts(HandRankTables::kSuitCountBias)
+		, numCards(cs.Size())
 	{
-		if( hand[0] == k0 || hand[1] == k0 || table[0] == k0 || table[1] == k0 || table[2] == k0 )
-			continue;
-		otherHand[0] = k0;
-		for( byte k1 = k0+1; k1 < 52; k1++ )
+		const auto& tables = HandRankTables::Get();
+		for (uint_fast8_t color = 0; color < static_cast<uint_fast8_t>(CardColor::Count); ++color)
 		{
-			if( hand[0] == k1 || hand[1] == k1 || table[0] == k1 || table[1] == k1 || table[2] == k1 )
-				continue;
-			otherHand[1] = k1;
-			for( byte turn = 0; turn < 51; turn++ )
-			{
-				if( hand[0] == turn || hand[1] == turn || otherHand[0] == turn || otherHand[1] == turn ||
-					table[0] == turn || table[1] == turn || table[2] == turn )
-					continue;
-				cards[5] = turn;
-				for( byte river = turn+1; river < 52; river++ )
-				{
-					if( hand[0] == river || hand[1] == river || otherHand[0] == river || otherHand[1] == river ||
-						table[0] == river || table[1] == river || table[2] == river )
-						continue;
-					cards[6] = river;
-					cards[0] = hand[0];
-					cards[1] = hand[1];
-					GetBestHand( cards, 7, bestHand1 );
-					cards[0] = otherHand[0];
-					cards[1] = otherHand[1];
-					GetBestHand( cards, 7, bestHand2 );
-					int res = CompareHands( bestHand1, bestHand2 );
-					nTotalHands++;
-					if( res == 1 )
-						nWonHands++;
-					else if( res == 0 )
-						nDrawHands++;
-				}
-			}
+			const auto suitMask = cs.SuitMask(static_cast<CardColor>(color));
+			rankKey += tables.SuitKey(suitMask);
+			suitCounts += PopCount(suitMask) << (color << 2);
 		}
 	}
-	fWin = (float)nWonHands / nTotalHands;
-	fDraw = (float)nDrawHands / nTotalHands;
+
+	// adds the card at the given CardSet bit
+	HandState AddBit(uint_fast8_t cardBit) const
+	{
+		const uint_fast8_t color = cardBit / CardSet::kColorShift;
+		const uint_fast8_t value = cardBit - color * CardSet::kColorShift;
+		HandState state(*this);
+		state.cards.mask |= uint64_t(1) << cardBit;
+		state.rankKey += HandRankTables::kValueKeys[value];
+		state.suitCounts += 1 << (color << 2);
+		++state.numCards;
+		return state;
+	}
+	HandState Add(const Card c) const
+	{
+		return AddBit(static_cast<uint_fast8_t>(c.color) * CardSet::kColorShift + static_cast<uint_fast8_t>(c.value));
+	}
+
+	// best 5-card rank, the state must hold 5 to 7 cards
+	HandRank Rank() const
+	{
+		assert(numCards >= 5 && numCards <= 7);
+		const auto& tables = HandRankTables::Get();
+		const auto flushCheck = suitCounts & HandRankTables::kFlushCheckMask;
+		if (flushCheck == 0)
+			return (numCards == 7) ? tables.NonFlushRank(rankKey) : GetHandRank(cards);
+		uint_fast8_t flushColor = 0;
+		while ((flushCheck >> (flushColor << 2)) != 8)
+			++flushColor;
+		return tables.FlushRank(cards.SuitMask(static_cast<CardColor>(flushColor)));
+	}
+
+	CardSet cards;
+	uint32_t rankKey;
+	uint32_t suitCounts;
+	uint8_t numCards;
+};
+
+enum class SimdLevel : uint8_t
+{
+	Scalar,
+	Sse42,
+	Avx2
+};
+
+SimdLevel DetectSimdLevel()
+{
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 0);
+	const int maxLeaf = info[0];
+	__cpuid(info, 1);
+	const bool sse42 = (info[2] & (1 << 20)) != 0 && (info[2] & (1 << 23)) != 0; // SSE4.2 and POPCNT
+	const bool osAvx = (info[2] & (1 << 27)) != 0 && (info[2] & (1 << 28)) != 0 && (_xgetbv(0) & 6) == 6;
+	bool avx2 = false;
+	if (maxLeaf >= 7 && osAvx)
+	{
+		__cpuidex(info, 7, 0);
+		avx2 = (info[1] & (1 << 5)) != 0;
+	}
+#else
+	__builtin_cpu_init();
+	const bool sse42 = __builtin_cpu_supports("sse4.2") && __builtin_cpu_supports("popcnt");
+	const bool avx2 = __builtin_cpu_supports("avx2");
+#endif
+	return avx2 ? SimdLevel::Avx2 : sse42 ? SimdLevel::Sse42 : SimdLevel::Scalar;
 }
 
-void DecideAfterFlop2( byte hand[], byte table[], float& fWin, float& fDraw, const int nTries )
+static void GetHandRanks7Scalar(const CardSet* hands, HandRank* ranks, size_t numHands)
 {
-	byte otherHand[2];
-	byte bestHand1[5];
-	byte bestHand2[5];
-	byte cards[7];
-	cards[2] = table[0];
-	cards[3] = table[1];
-	cards[4] = table[2];
-	const int nTotalHands = nTries;
-	int nWonHands = 0;
-	int nDrawHands = 0;
-	for( int k = 0; k < nTotalHands; k++ )
+	for (size_t k = 0; k < numHands; ++k)
 	{
-		otherHand[0] = rand() % 52;
-		while( hand[0] == otherHand[0] || hand[1] == otherHand[0] || table[0] == otherHand[0] || table[1] == otherHand[0] || table[2] == otherHand[0] )
-			otherHand[0] = rand() % 52;
-
-		otherHand[1] = rand() % 52;
-		while( hand[0] == otherHand[1] || hand[1] == otherHand[1] || table[0] == otherHand[1] || table[1] == otherHand[1] || table[2] == otherHand[1] ||
-			otherHand[0] == otherHand[1] )
-			otherHand[1] = rand() % 52;
-
-		cards[5] = rand() % 52;
-		while( hand[0] == cards[5] || hand[1] == cards[5] || table[0] == cards[5] || table[1] == cards[5] || table[2] == cards[5] ||
-			otherHand[0] == cards[5] || otherHand[1] == cards[5] )
-			cards[5] = rand() % 52;
-
-		cards[6] = rand() % 52;
-		while( hand[0] == cards[6] || hand[1] == cards[6] || table[0] == cards[6] || table[1] == cards[6] || table[2] == cards[6] ||
-			otherHand[0] == cards[6] || otherHand[1] == cards[6] || cards[5] == cards[6] )
-			cards[6] = rand() % 52;
-
-		cards[0] = hand[0];
-		cards[1] = hand[1];
-		GetBestHand( cards, 7, bestHand1 );
-		cards[0] = otherHand[0];
-		cards[1] = otherHand[1];
-		GetBestHand( cards, 7, bestHand2 );
-		int res = CompareHands( bestHand1, bestHand2 );
-		if( res == 1 )
-			nWonHands++;
-		else if( res == 0 )
-			nDrawHands++;
+		ranks[k] = GetHandRank(hands[k]);
 	}
-	fWin = (float)nWonHands / nTotalHands;
-	fDraw = (float)nDrawHands / nTotalHands;
 }
 
-void DecideAfterTurn( byte hand[], byte table[], float& fWin, float& fDraw )
+// Same lookups as GetHandRank(std::array<Card, 7>), but the rank key is built from the suit masks with the
+// hardware popcount spotting flushes.
+TARGET_SSE42 static void GetHandRanks7Sse42(const CardSet* hands, HandRank* ranks, size_t numHands)
 {
-	byte otherHand[2];
-	byte bestHand1[5];
-	byte bestHand2[5];
-	byte cards[7];
-	cards[2] = table[0];
-	cards[3] = table[1];
-	cards[4] = table[2];
-	cards[5] = table[3];
-	int nTotalHands = 0;
-	int nWonHands = 0;
-	int nDrawHands = 0;
-	for( byte k0 = 0; k0 < 51; k0++ )
+	const auto& tables = HandRankTables::Get();
+	for (size_t k = 0; k < numHands; ++k)
 	{
-		if( hand[0] == k0 || hand[1] == k0 || table[0] == k0 || table[1] == k0 || table[2] == k0 || table[3] == k0 )
-			continue;
-		otherHand[0] = k0;
-		for( byte k1 = k0+1; k1 < 52; k1++ )
-		{
-			if( hand[0] == k1 || hand[1] == k1 || table[0] == k1 || table[1] == k1 || table[2] == k1 || table[3] == k1 )
-				continue;
-			otherHand[1] = k1;
-			for( byte river = 0; river < 52; river++ )
-			{
-				if( hand[0] == river || hand[1] == river || otherHand[0] == river || otherHand[1] == river ||
-					table[0] == river || table[1] == river || table[2] == river || table[3] == river )
-					continue;
-				cards[6] = river;
-				cards[0] = hand[0];
-				cards[1] = hand[1];
-				GetBestHand( cards, 7, bestHand1 );
-				cards[0] = otherHand[0];
-				cards[1] = otherHand[1];
-				GetBestHand( cards, 7, bestHand2 );
-				int res = CompareHands( bestHand1, bestHand2 );
-				nTotalHands++;
-				if( res == 1 )
-					nWonHands++;
-				else if( res == 0 )
-					nDrawHands++;
-			}
-		}
+		const auto s = hands[k].SuitMask(CardColor::Spade);
+		const auto h = hands[k].SuitMask(CardColor::Heart);
+		const auto d = hands[k].SuitMask(CardColor::Diamond);
+		const auto c = hands[k].SuitMask(CardColor::Club);
+		if (_mm_popcnt_u32(s) >= 5)
+			ranks[k] = tables.FlushRank(s);
+		else if (_mm_popcnt_u32(h) >= 5)
+			ranks[k] = tables.FlushRank(h);
+		else if (_mm_popcnt_u32(d) >= 5)
+			ranks[k] = tables.FlushRank(d);
+		else if (_mm_popcnt_u32(c) >= 5)
+			ranks[k] = tables.FlushRank(c);
+		else
+			ranks[k] = tables.NonFlushRank(tables.SuitKey(s) + tables.SuitKey(h) + tables.SuitKey(d) + tables.SuitKey(c));
 	}
-	fWin = (float)nWonHands / nTotalHands;
-	fDraw = (float)nDrawHands / nTotalHands;
 }
 
-void DecideAfterRiver( byte hand[], byte table[], float& fWin, float& fDraw )
+// popcount of 8 lanes holding at most 16 bits each
+TARGET_AVX2 static inline __m256i PopCount16x8(__m256i x)
 {
-	byte otherHand[2];
-	byte bestHand1[5];
-	byte bestHand2[5];
-	byte cards[7];
-	cards[2] = table[0];
-	cards[3] = table[1];
-	cards[4] = table[2];
-	cards[5] = table[3];
-	cards[6] = table[4];
-	int nTotalHands = 0;
-	int nWonHands = 0;
-	int nDrawHands = 0;
-	for( byte k0 = 0; k0 < 51; k0++ )
+	x = _mm256_sub_epi32(x, _mm256_and_si256(_mm256_srli_epi32(x, 1), _mm256_set1_epi32(0x55555555)));
+	x = _mm256_add_epi32(_mm256_and_si256(x, _mm256_set1_epi32(0x33333333)), _mm256_and_si256(_mm256_srli_epi32(x, 2), _mm256_set1_epi32(0x33333333)));
+	x = _mm256_and_si256(_mm256_add_epi32(x, _mm256_srli_epi32(x, 4)), _mm256_set1_epi32(0x0F0F0F0F));
+	return _mm256_and_si256(_mm256_add_epi32(x, _mm256_srli_epi32(x, 8)), _mm256_set1_epi32(0xFF));
+}
+
+// 8 hands per iteration: the suit masks go to 32-bit lanes, flushes are found with a SWAR popcount and both
+// the rank key and the rank come from gathers into the HandRankTables.
+TARGET_AVX2 static void GetHandRanks7Avx2(const CardSet* hands, HandRank* ranks, size_t numHands)
+{
+	const auto& tables = HandRankTables::Get();
+	const auto* suitKeys = reinterpret_cast<const int*>(tables.SuitKeys());
+	const auto* nonFlushRanks = reinterpret_cast<const int*>(tables.NonFlushRanks());
+	const auto* flushRanks = reinterpret_cast<const int*>(tables.FlushRanks());
+
+	const __m256i colorMask = _mm256_set1_epi32(CardSet::kColorMask);
+	const __m256i rankMask = _mm256_set1_epi32(0xFFFF);
+	const __m256i four = _mm256_set1_epi32(4);
+	const __m256i splitHalves = _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7);
+
+	size_t k = 0;
+	for (; k + 8 <= numHands; k += 8)
 	{
-		if( hand[0] == k0 || hand[1] == k0 || table[0] == k0 || table[1] == k0 || table[2] == k0 || table[3] == k0 )
-			continue;
-		otherHand[0] = k0;
-		for( byte k1 = k0+1; k1 < 52; k1++ )
+		// low and high halves of the 8 masks
+		const __m256i a = _mm256_permutevar8x32_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(hands + k)), splitHalves);
+		const __m256i b = _mm256_permutevar8x32_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(hands + k + 4)), splitHalves);
+		const __m256i lo = _mm256_permute2x128_si256(a, b, 0x20);
+		const __m256i hi = _mm256_permute2x128_si256(a, b, 0x31);
+
+		const __m256i s = _mm256_and_si256(lo, colorMask);
+		const __m256i h = _mm256_and_si256(_mm256_srli_epi32(lo, 13), colorMask);
+		const __m256i d = _mm256_and_si256(_mm256_or_si256(_mm256_srli_epi32(lo, 26), _mm256_slli_epi32(hi, 6)), colorMask);
+		const __m256i c = _mm256_and_si256(_mm256_srli_epi32(hi, 7), colorMask);
+
+		const __m256i keys = _mm256_add_epi32(
+			_mm256_add_epi32(_mm256_i32gather_epi32(suitKeys, s, 4), _mm256_i32gather_epi32(suitKeys, h, 4)),
+			_mm256_add_epi32(_mm256_i32gather_epi32(suitKeys, d, 4), _mm256_i32gather_epi32(suitKeys, c, 4)));
+		__m256i result = _mm256_and_si256(_mm256_i32gather_epi32(nonFlushRanks, keys, 2), rankMask);
+
+		const __m256i sFlush = _mm256_cmpgt_epi32(PopCount16x8(s), four);
+		const __m256i hFlush = _mm256_cmpgt_epi32(PopCount16x8(h), four);
+		const __m256i dFlush = _mm256_cmpgt_epi32(PopCount16x8(d), four);
+		const __m256i cFlush = _mm256_cmpgt_epi32(PopCount16x8(c), four);
+		const __m256i flush = _mm256_or_si256(_mm256_or_si256(sFlush, hFlush), _mm256_or_si256(dFlush, cFlush));
+		if (!_mm256_testz_si256(flush, flush))
 		{
-			if( hand[0] == k1 || hand[1] == k1 || table[0] == k1 || table[1] == k1 || table[2] == k1 || table[3] == k1 )
-				continue;
-			otherHand[1] = k1;
-
-			cards[0] = hand[0];
-			cards[1] = hand[1];
-			GetBestHand( cards, 7, bestHand1 );
-			cards[0] = otherHand[0];
-			cards[1] = otherHand[1];
-			GetBestHand( cards, 7, bestHand2 );
-			int res = CompareHands( bestHand1, bestHand2 );
-			nTotalHands++;
-			if( res == 1 )
-				nWonHands++;
-			else if( res == 0 )
-				nDrawHands++;
+			// at most one suit per hand can hold 5 of 7 cards
+			const __m256i flushSuit = _mm256_or_si256(
+				_mm256_or_si256(_mm256_and_si256(sFlush, s), _mm256_and_si256(hFlush, h)),
+				_mm256_or_si256(_mm256_and_si256(dFlush, d), _mm256_and_si256(cFlush, c)));
+			const __m256i flushRank = _mm256_and_si256(_mm256_i32gather_epi32(flushRanks, flushSuit, 2), rankMask);
+			result = _mm256_blendv_epi8(result, flushRank, flush);
 		}
+
+		const __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi32(result, result), 0x08);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(ranks + k), _mm256_castsi256_si128(packed));
 	}
-	fWin = (float)nWonHands / nTotalHands;
-	fDraw = (float)nDrawHands / nTotalHands;
+
+	GetHandRanks7Scalar(hands + k, ranks + k, numHands - k);
 }
 
-void RefreshComputerStack( int value )
+// Ranks a batch of 7-card hands with the widest kernel the CPU supports.
+void GetHandRanks7(const CardSet* hands, HandRank* ranks, size_t numHands)
 {
-	mvprintw(0,0,"                                                                        ");
-	mvprintw(0,0,"Computer stack: %d$", value);
-	refresh();
+	typedef void (*GetHandRanksFunction)(const CardSet*, HandRank*, size_t);
+	static const GetHandRanksFunction function = []() -> GetHandRanksFunction {
+		switch (DetectSimdLevel())
+		{
+		case SimdLevel::Avx2: return &GetHandRanks7Avx2;
+		case SimdLevel::Sse42: return &GetHandRanks7Sse42;
+		default: return &GetHandRanks7Scalar;
+		}
+	}();
+	function(hands, ranks, numHands);
 }
 
-void RefreshHumanStack( int value )
+void sortCards( byte cards[5] )
 {
-	mvprintw(1,0,"                                                                        ");
-	mvprintw(1,0,"Your stack: %d$", value);
-	refresh();
+	byte temp;
+	for( byte i = 0; i < 4; i++ )
+		for( byte j = i+1; j < 5; j++ )
+			if( cards[i] > cards[j] ){
+				temp = cards[i];
+				cards[i] = cards[j];
+				cards[j] = temp;
+			}
 }
 
-void RefreshPot( int value )
+void PrintSymbol( char* str, byte card )
 {
-	mvprintw(2,0,"                                                                        ");
-	mvprintw(2,0,"Pot: %d$", value);
-	refresh();
+	byte val = card >> 2;
+	char cval = val + 2;
+
+	str[0] = ' ';
+
+	if( val < 8 )
+		str[1] = '0' + cval;
+	else if( val == 8 ){
+		str[0] = '1';
+		str[1] = '0';
+	}
+	else
+	{
+		switch( val ){
+			case  9: str[1] = 'J'; break;
+			case 10: str[1] = 'Q'; break;
+			case 11: str[1] = 'K'; break;
+			case 12: str[1] = 'A'; break;
+		}
+	}
+
+	switch( card & 3 ){
+		case 0: str[2] = 's'; break;
+		case 1: str[2] = 'h'; break;
+		case 2: str[2] = 'd'; break;
+		case 3: str[2] = 'c'; break;
+	}
 }
 
-void GameOn()
+void PrintHand( char* str, byte cards[5] )
 {
-	srand( GetTickCount() );
-
-	byte cards[2][2];
-	byte table[5];
-	byte cardsDealt[9];
+	PrintSymbol( str, cards[0] );
+	str[3] = ' ';
+	PrintSymbol( str + 4, cards[1] );
+	str[7] = ' ';
+	PrintSymbol( str + 8, cards[2] );
+	str[11] = ' ';
+	PrintSymbol( str + 12, cards[3] );
+	str[15] = ' ';
+	PrintSymbol( str + 16, cards[4] );
+}
 
-	int stack[2] = { 1000, 1000 };
-	int pot, dStack, minBet, count = 0, logpos = 6;
+void SaveAllHandsToFile()
+{
+	byte cards[5];
+	HandType ht;
+	int kHand = 0;
+	//char sHand[19];
+	int stats[9];
 
-	float fWin, fDraw;
+	memset( stats, 0, 9 * sizeof(int) );
 
-	initscr();
+	//FILE *f;
+	//fopen_s( &f, "C:\\poker.txt", "wt" );
 
-	while( 1 )
+	for( byte k0 = 0; k0 < 48; k0++ )
 	{
-		getch();
-		erase();
+		cards[0] = k0;
+		for( byte k1 = k0+1; k1 < 49; k1++ )
+		{
+			cards[1] = k1;
+			for( byte k2 = k1+1; k2 < 50; k2++ )
+			{
+				cards[2] = k2;
+				for( byte k3 = k2+1; k3 < 51; k3++ )
+				{
+					cards[3] = k3;
+					for( byte k4 = k3+1; k4 < 52; k4++ )
+					{
+						cards[4] = k4;
+						ht = GetHandType( cards );
+						stats[(int)ht]++;
+						//PrintHand( sHand, cards );
+						//fprintf( f, "%.7i %s   %s\n", kHand++, sHand, g_den[ht] );
+					}
+				}
+			}
+		}
+	}
 
-		logpos = 6;
+	for( byte i = 0; i < 9; i++ )
+		printf( "%d %d\n", i, stats[i] );
 
-		pot = 0;
+	char x;
+	scanf_s("%c", &x, 1);
 
-		cards[0][0] = DealCard( cardsDealt, 0 );
-		cards[1][0] = DealCard( cardsDealt, 1 );
-		cards[0][1] = DealCard( cardsDealt, 2 );
+	//fclose( f );
+}
+
+// the generator of the game's deals, one per thread
+Philox4x32& DealingRandom()
+{
+	static thread_local Philox4x32 random( 5489, 0 );
+	return random;
+}
+
+void SeedDealing( uint64_t seed )
+{
+	DealingRandom() = Philox4x32( seed, 0 );
+}
+
+// a uniform pick among the cards not dealt yet, in one draw: its index among the live cards becomes a card by
+// DepositBits
+byte DealCard( byte cardsDealt[], byte nCardsDealt )
+{
+	uint64_t liveCards = ( uint64_t( 1 ) << 52 ) - 1;
+	for( byte i = 0; i < nCardsDealt; i++ )
+		liveCards &= ~( uint64_t( 1 ) << cardsDealt[i] );
+	const uint32_t index = DealingRandom().Below( PopCount( liveCards ) );
+	const byte card = LowestBit( DepositBits( uint64_t( 1 ) << index, liveCards ) );
+	cardsDealt[nCardsDealt] = card;
+	return card;
+}
+
+void GetBestHand( byte cards[], byte nCards, byte bestHand[] )
+{
+	byte idx[5] = { 0, 1, 2, 3, 4 };
+	bestHand[0] = cards[idx[0]];
+	bestHand[1] = cards[idx[1]];
+	bestHand[2] = cards[idx[2]];
+	bestHand[3] = cards[idx[3]];
+	bestHand[4] = cards[idx[4]];
+	sortCards( bestHand );
+	byte newHand[5];
+	while( idx[0] < nCards - 5 )
+	{
+		for( byte i = 4; i >= 0; i-- )
+			if( idx[i] < nCards - 5 + i ){
+				idx[i]++;
+				for( byte j = i+1; j < 5; j++ )
+					idx[j] = idx[j-1] + 1;
+				break;
+			}
+		newHand[0] = cards[idx[0]];
+		newHand[1] = cards[idx[1]];
+		newHand[2] = cards[idx[2]];
+		newHand[3] = cards[idx[3]];
+		newHand[4] = cards[idx[4]];
+		sortCards( newHand );
+
+		if( CompareHands( bestHand, newHand ) == -1 ){
+			bestHand[0] = newHand[0];
+			bestHand[1] = newHand[1];
+			bestHand[2] = newHand[2];
+			bestHand[3] = newHand[3];
+			bestHand[4] = newHand[4];
+		}
+	}
+}
+
+void DecideBeforeDeal()
+{
+
+}
+
+CardSet ToCardSet( const byte cards[], byte nCards )
+{
+	CardSet cardSet;
+	for( byte i = 0; i < nCards; i++ )
+		cardSet |= Card( cards[i] );
+	return cardSet;
+}
+
+struct Chances
+{
+	Chances() : total(0), winning(0), split(0) {}
+	Chances& operator+=(const Chances& c) { total += c.total; winning += c.winning; split += c.split; return *this; }
+	const Chances operator+(const Chances& c) const { return Chances(*this) += c; }
+	Chances& operator*=(uintmax_t weight) { total *= weight; winning *= weight; split *= weight; return *this; }
+	const Chances operator*(uintmax_t weight) const { return Chances(*this) *= weight; }
+
+	uintmax_t total;
+	uintmax_t winning;
+	uintmax_t split;
+};
+
+// Every live two-card holding on a complete board ranked once and sorted, all of them and per card. The holdings a
+// hand beats or ties come from binary searches, and the ones sharing a card with it are taken out card by card, so no
+// two holdings are compared.
+class RiverRankTable
+{
+public:
+	// deadCards are out of the deck
+	explicit RiverRankTable(CardSet boardCards, CardSet deadCards = CardSet());
+
+	// showdowns of handCards against every live holding not sharing a card with it
+	Chances GetChances(CardSet handCards) const;
+	// the same for numHands hands at once
+	void GetChances(const CardSet* hands, Chances* chances, size_t numHands) const;
+
+private:
+	static const uint_fast8_t kNumCards = CardSet::kColorShift * static_cast<uint_fast8_t>(CardColor::Count);
+	static const uint_fast8_t kMaxLiveCards = kNumCards - 5;
+	static const uint_fast16_t kMaxHoldings = kMaxLiveCards * (kMaxLiveCards - 1) / 2;
+
+	// how many of the first count ranks are below rank, and up to it
+	static uint_fast16_t CountBelow(const HandRank* ranks, uint_fast16_t count, HandRank rank)
+	{
+		return static_cast<uint_fast16_t>(std::lower_bound(ranks, ranks + count, rank) - ranks);
+	}
+	static uint_fast16_t CountUpTo(const HandRank* ranks, uint_fast16_t count, HandRank rank)
+	{
+		return static_cast<uint_fast16_t>(std::upper_bound(ranks, ranks + count, rank) - ranks);
+	}
+
+	HandState mBoardState;
+	uint64_t mLiveMask;
+	uint_fast16_t mNumHoldings;
+	std::array<HandRank, kMaxHoldings> mRanks;
+	// how many holdings hold each card, and their ranks in order
+	std::array<uint_fast8_t, kNumCards> mNumCardHoldings;
+	std::array<std::array<HandRank, kMaxLiveCards - 1>, kNumCards> mCardRanks;
+};
+
+RiverRankTable::RiverRankTable(CardSet boardCards, CardSet deadCards)
+	: mBoardState(boardCards)
+	, mLiveMask(((uint64_t(1) << kNumCards) - 1) & ~(boardCards | deadCards).mask)
+	, mNumHoldings(0)
+	, mNumCardHoldings()
+{
+	assert(boardCards.Size() == 5);
+
+	// the rank above the cards, so sorting by rank sorts the per card lists too; the holdings are sorted with two
+	// radix passes, a rank byte each, their histograms counted while ranking, far cheaper than comparing a thousand
+	// holdings
+	std::array<uint32_t, kMaxHoldings> holdings;
+	std::array<std::array<uint_fast16_t, 257>, 2> offsets = {};
+	for (auto lowCards = mLiveMask; lowCards != 0; lowCards &= lowCards - 1)
+	{
+		const auto low = LowestBit(lowCards);
+		const auto lowState = mBoardState.AddBit(low);
+		for (auto highCards = lowCards & (lowCards - 1); highCards != 0; highCards &= highCards - 1)
+		{
+			const auto high = LowestBit(highCards);
+			const auto rank = lowState.AddBit(high).Rank();
+			++offsets[0][(rank & 0xFF) + 1];
+			++offsets[1][(rank >> 8) + 1];
+			holdings[mNumHoldings++] = uint32_t(rank) << 12 | low << 6 | high;
+		}
+	}
+
+	for (uint_fast16_t b = 1; b < offsets[0].size(); ++b)
+	{
+		offsets[0][b] += offsets[0][b - 1];
+		offsets[1][b] += offsets[1][b - 1];
+	}
+	std::array<uint32_t, kMaxHoldings> buffer;
+	for (uint_fast16_t k = 0; k < mNumHoldings; ++k)
+		buffer[offsets[0][holdings[k] >> 12 & 0xFF]++] = holdings[k];
+	for (uint_fast16_t k = 0; k < mNumHoldings; ++k)
+		holdings[offsets[1][buffer[k] >> 20]++] = buffer[k];
+
+	for (uint_fast16_t k = 0; k < mNumHoldings; ++k)
+	{
+		const auto rank = static_cast<HandRank>(holdings[k] >> 12);
+		const uint_fast8_t low = holdings[k] >> 6 & 63;
+		const uint_fast8_t high = holdings[k] & 63;
+		mRanks[k] = rank;
+		mCardRanks[low][mNumCardHoldings[low]++] = rank;
+		mCardRanks[high][mNumCardHoldings[high]++] = rank;
+	}
+}
+
+Chances RiverRankTable::GetChances(CardSet handCards) const
+{
+	assert(handCards.Size() == 2 && !handCards.Intersects(mBoardState.cards));
+
+	const auto low = LowestBit(handCards.mask);
+	const auto high = LowestBit(handCards.mask & (handCards.mask - 1));
+	const auto rank = mBoardState.AddBit(low).AddBit(high).Rank();
+	// the hand itself is among the holdings of both its cards, and ties with itself
+	const uint_fast8_t isLive = ((handCards.mask & ~mLiveMask) == 0) ? 1 : 0;
+
+	const auto below = CountBelow(mRanks.data(), mNumHoldings, rank)
+		- CountBelow(mCardRanks[low].data(), mNumCardHoldings[low], rank)
+		- CountBelow(mCardRanks[high].data(), mNumCardHoldings[high], rank);
+	const auto upTo = CountUpTo(mRanks.data(), mNumHoldings, rank) + isLive
+		- CountUpTo(mCardRanks[low].data(), mNumCardHoldings[low], rank)
+		- CountUpTo(mCardRanks[high].data(), mNumCardHoldings[high], rank);
+
+	Chances chances;
+	chances.total = mNumHoldings + isLive - mNumCardHoldings[low] - mNumCardHoldings[high];
+	chances.winning = below;
+	chances.split = upTo - below;
+	return chances;
+}
+
+void RiverRankTable::GetChances(const CardSet* hands, Chances* chances, size_t numHands) const
+{
+	for (size_t k = 0; k < numHands; ++k)
+	{
+		chances[k] = GetChances(hands[k]);
+	}
+}
+
+// GetChances of hands on a turn board against every live holding, summed over the rivers. Each river gets one
+// RiverRankTable answering all the hands, each hand skipping the rivers it holds; the rivers are split over the
+// pool threads. With riverSymmetry, only the smallest river of every orbit is dealt, weighted by the orbit size.
+static void GetTurnChances(const CardSet* hands, Chances* chances, size_t numHands, CardSet boardCards, CardSet deadCards,
+	const SuitSymmetry* riverSymmetry)
+{
+	static const uint_fast8_t kNumCards = CardSet::kColorShift * static_cast<uint_fast8_t>(CardColor::Count);
+	assert(boardCards.Size() == 4);
+
+	const uint64_t riverMask = ((uint64_t(1) << kNumCards) - 1) & ~(boardCards | deadCards).mask;
+	std::fill(chances, chances + numHands, Chances());
+	std::mutex resultMutex;
+	ThreadPool::Get().ParallelFor(PopCount(riverMask), 1, [&](uint64_t begin, uint64_t end) {
+		for (auto k = begin; k < end; ++k)
+		{
+			const uint64_t river = DepositBits(uint64_t(1) << k, riverMask);
+			const CardSet riverBoardCards(boardCards.mask | river);
+			const uint_fast32_t weight = (riverSymmetry != nullptr) ? riverSymmetry->OrbitWeight(riverBoardCards) : 1;
+			if (weight == 0)
+				continue;
+
+			const Arena::Scope arenaScope(Arena::Local());
+			Chances* const riverChances = Arena::Local().Allocate<Chances>(numHands);
+			const RiverRankTable rankTable(riverBoardCards, deadCards);
+			for (size_t hand = 0; hand < numHands; ++hand)
+			{
+				if ((hands[hand].mask & river) == 0)
+					riverChances[hand] = rankTable.GetChances(hands[hand]) * weight;
+			}
+
+			std::lock_guard<std::mutex> lk(resultMutex);
+			for (size_t hand = 0; hand < numHands; ++hand)
+			{
+				chances[hand] += riverChances[hand];
+			}
+		}
+	});
+}
+
+// the same for every hand of a range
+void GetTurnChances(const CardSet* hands, Chances* chances, size_t numHands, CardSet boardCards, CardSet deadCards = CardSet())
+{
+	GetTurnChances(hands, chances, numHands, boardCards, deadCards, nullptr);
+}
+
+// the same for a single hand, dealing only the rivers not equal to a smaller one up to the suit permutations keeping
+// the hand, the board and the dead cards in place
+Chances GetTurnChances(CardSet handCards, CardSet boardCards, CardSet deadCards = CardSet())
+{
+	const auto riverSymmetry = SuitSymmetry().Stabilizer(handCards).Stabilizer(boardCards).Stabilizer(deadCards);
+	Chances chances;
+	GetTurnChances(&handCards, &chances, 1, boardCards, deadCards, &riverSymmetry);
+	return chances;
+}
+
+// GetChances of a hand on a flop, kept split by turn card as well, so that once the turn falls its chances are a
+// lookup instead of a new query; they equal those of the turn query. Every runout adds its chances to both of its
+// cards, as either may be the turn. Compute may be called again for the next flop and does not allocate.
+class FlopChances
+{
+public:
+	// handCards against opponentCards, or against every live holding when opponentCards is empty
+	void Compute(CardSet handCards, CardSet opponentCards, CardSet flopCards, CardSet deadCards = CardSet());
+
+	// over every turn and river
+	const Chances& GetChances() const { return mChances; }
+	// over every river once turnCard fell; nothing for a card out of the deck
+	const Chances& GetTurnChances(const Card turnCard) const { return mTurnChances[LowestBit(CardSet::Bit(turnCard))]; }
+
+private:
+	static const uint_fast8_t kNumCards = CardSet::kColorShift * static_cast<uint_fast8_t>(CardColor::Count);
+
+	Chances mChances;
+	std::array<Chances, kNumCards> mTurnChances;
+};
+
+void FlopChances::Compute(CardSet handCards, CardSet opponentCards, CardSet flopCards, CardSet deadCards)
+{
+	assert(handCards.Size() == 2);
+	assert(opponentCards.Size() == 0 || opponentCards.Size() == 2);
+	assert(flopCards.Size() == 3);
+
+	const uint64_t liveMask = ((uint64_t(1) << kNumCards) - 1) & ~(handCards | opponentCards | flopCards | deadCards).mask;
+	const CardSet outCards = opponentCards | deadCards;
+	auto runoutChances = [&](CardSet boardCards) {
+		if (opponentCards.mask == 0)
+			return RiverRankTable(boardCards, outCards).GetChances(handCards);
+
+		const auto handRank = GetHandRank(handCards | boardCards);
+		const auto opponentRank = GetHandRank(opponentCards | boardCards);
+		Chances chances;
+		chances.total = 1;
+		chances.winning = (handRank > opponentRank) ? 1 : 0;
+		chances.split = (handRank == opponentRank) ? 1 : 0;
+		return chances;
+	};
+
+	mChances = Chances();
+	mTurnChances.fill(Chances());
+
+	// the runouts split into ranges for a few pool tasks per thread
+	std::mutex resultMutex;
+	ParallelForEachSubset(liveMask, 2, [&](uint64_t begin, uint64_t end) {
+		Chances chances;
+		std::array<Chances, kNumCards> turnChances;
+		auto addRunout = [&](uint64_t runout) {
+			const auto c = runoutChances(CardSet(flopCards.mask | runout));
+			chances += c;
+			turnChances[LowestBit(runout)] += c;
+			turnChances[LowestBit(runout & (runout - 1))] += c;
+		};
+		ForEachSubsetInRange(liveMask, 2, begin, end, addRunout);
+
+		std::lock_guard<std::mutex> lk(resultMutex);
+		mChances += chances;
+		for (uint_fast8_t card = 0; card < kNumCards; ++card)
+		{
+			mTurnChances[card] += turnChances[card];
+		}
+	});
+}
+
+void DecideAfterFlop( byte hand[], byte table[], float& fWin, float& fDraw )
+{
+	const CardSet tableCards = ToCardSet( table, 3 );
+	const HandState handState( ToCardSet( hand, 2 ) | tableCards );
+	int nTotalHands = 0;
+	int nWonHands = 0;
+	int nDrawHands = 0;
+	for( byte k0 = 0; k0 < 51; k0++ )
+	{
+		if( hand[0] == k0 || hand[1] == k0 || table[0] == k0 || table[1] == k0 || table[2] == k0 )
+			continue;
+		for( byte k1 = k0+1; k1 < 52; k1++ )
+		{
+			if( hand[0] == k1 || hand[1] == k1 || table[0] == k1 || table[1] == k1 || table[2] == k1 )
+				continue;
+			const HandState otherState( CardSet() | Card( k0 ) | Card( k1 ) | tableCards );
+			for( byte turn = 0; turn < 51; turn++ )
+			{
+				if( hand[0] == turn || hand[1] == turn || k0 == turn || k1 == turn ||
+					table[0] == turn || table[1] == turn || table[2] == turn )
+					continue;
+				const HandState handTurnState = handState.Add( Card( turn ) );
+				const HandState otherTurnState = otherState.Add( Card( turn ) );
+				for( byte river = turn+1; river < 52; river++ )
+				{
+					if( hand[0] == river || hand[1] == river || k0 == river || k1 == river ||
+						table[0] == river || table[1] == river || table[2] == river )
+						continue;
+					HandRank rank1 = handTurnState.Add( Card( river ) ).Rank();
+					HandRank rank2 = otherTurnState.Add( Card( river ) ).Rank();
+					nTotalHands++;
+					if( rank1 > rank2 )
+						nWonHands++;
+					else if( rank1 == rank2 )
+						nDrawHands++;
+				}
+			}
+		}
+	}
+	fWin = (float)nWonHands / nTotalHands;
+	fDraw = (float)nDrawHands / nTotalHands;
+}
+
+void DecideAfterFlop2( byte hand[], byte table[], float& fWin, float& fDraw, const int nTries )
+{
+	const CardSet handCards = ToCardSet( hand, 2 );
+	const CardSet tableCards = ToCardSet( table, 3 );
+	const uint64_t deckMask = ( uint64_t( 1 ) << CardDealer::kNumCards ) - 1;
+	CardDealer dealer( CardSet( deckMask & ~( handCards | tableCards ).mask ) );
+	auto& random = DealingRandom();
+	const int nTotalHands = nTries;
+	int nWonHands = 0;
+	int nDrawHands = 0;
+	for( int k = 0; k < nTotalHands; k++ )
+	{
+		dealer.Reset();
+		const CardSet otherHand = dealer.Deal( random, 2 );
+		const CardSet board = tableCards | dealer.Deal( random, 2 );
+		HandRank rank1 = GetHandRank( handCards | board );
+		HandRank rank2 = GetHandRank( otherHand | board );
+		if( rank1 > rank2 )
+			nWonHands++;
+		else if( rank1 == rank2 )
+			nDrawHands++;
+	}
+	fWin = (float)nWonHands / nTotalHands;
+	fDraw = (float)nDrawHands / nTotalHands;
+}
+
+void DecideAfterTurn( byte hand[], byte table[], float& fWin, float& fDraw )
+{
+	const Chances chances = GetTurnChances( ToCardSet( hand, 2 ), ToCardSet( table, 4 ) );
+	fWin = (float)chances.winning / chances.total;
+	fDraw = (float)chances.split / chances.total;
+}
+
+void DecideAfterRiver( byte hand[], byte table[], float& fWin, float& fDraw )
+{
+	const RiverRankTable rankTable( ToCardSet( table, 5 ) );
+	const Chances chances = rankTable.GetChances( ToCardSet( hand, 2 ) );
+	fWin = (float)chances.winning / chances.total;
+	fDraw = (float)chances.split / chances.total;
+}
+
+void RefreshComputerStack( int value )
+{
+	mvprintw(0,0,"                                                                        ");
+	mvprintw(0,0,"Computer stack: %d$", value);
+	refresh();
+}
+
+void RefreshHumanStack( int value )
+{
+	mvprintw(1,0,"                                                                        ");
+	mvprintw(1,0,"Your stack: %d$", value);
+	refresh();
+}
+
+void RefreshPot( int value )
+{
+	mvprintw(2,0,"                                                                        ");
+	mvprintw(2,0,"Pot: %d$", value);
+	refresh();
+}
+
+void GameOn()
+{
+	srand( GetTickCount() );
+	SeedDealing( GetTickCount() );
+
+	byte cards[2][2];
+	byte table[5];
+	byte cardsDealt[9];
+
+	int stack[2] = { 1000, 1000 };
+	int pot, dStack, minBet, count = 0, logpos = 6;
+
+	float fWin, fDraw;
+	// the flop chances split by turn card, so the turn costs a lookup
+	FlopChances flopChances;
+
+	initscr();
+
+	while( 1 )
+	{
+		getch();
+		erase();
+
+		logpos = 6;
+
+		pot = 0;
+
+		cards[0][0] = DealCard( cardsDealt, 0 );
+		cards[1][0] = DealCard( cardsDealt, 1 );
+		cards[0][1] = DealCard( cardsDealt, 2 );
 		cards[1][1] = DealCard( cardsDealt, 3 );
 
 		dStack = MIN( stack[0], 10 );
@@ -1164,7 +2159,10 @@ void GameOn()
 				mvprintw(3,15,"%s",sCard);
 				refresh();
 
-				DecideAfterFlop( cards[0], table, fWin, fDraw );
+				flopChances.Compute( ToCardSet( cards[0], 2 ), CardSet(), ToCardSet( table, 3 ) );
+				const Chances& chances = flopChances.GetChances();
+				fWin = (float)chances.winning / chances.total;
+				fDraw = (float)chances.split / chances.total;
 			}
 			if( step == 1 ){
 				table[3] = DealCard( cardsDealt, 7 );
@@ -1179,7 +2177,9 @@ void GameOn()
 				mvprintw(3,19,"%s",sCard);
 				refresh();
 
-				DecideAfterTurn( cards[0], table, fWin, fDraw );
+				const Chances& chances = flopChances.GetTurnChances( Card( table[3] ) );
+				fWin = (float)chances.winning / chances.total;
+				fDraw = (float)chances.split / chances.total;
 			}
 			if( step == 2 ){
 				table[4] = DealCard( cardsDealt, 8 );
@@ -1322,706 +2322,2316 @@ void GameOn()
 						RefreshPot( pot );
 						break;
 					}
-					r = r / fWin + fDraw;
-					if( r > .9f )
-						bet = stack[0];
-					else if( r > .7f )
-						bet = 2 * minBet;
-					else
-						bet = int(2 * minBet + (2 * r * minBet));
-					bet = MIN( bet, stack[0] );
-					stack[0] -= bet;
-					pot += bet;
-					minBet = bet - minBet;
-					mvprintw(logpos++,0,"Computer raises %d.", minBet);
+					r = r / fWin + fDraw;
+					if( r > .9f )
+						bet = stack[0];
+					else if( r > .7f )
+						bet = 2 * minBet;
+					else
+						bet = int(2 * minBet + (2 * r * minBet));
+					bet = MIN( bet, stack[0] );
+					stack[0] -= bet;
+					pot += bet;
+					minBet = bet - minBet;
+					mvprintw(logpos++,0,"Computer raises %d.", minBet);
+				}
+				RefreshComputerStack( stack[0] );
+				RefreshPot( pot );
+			}
+
+			if( ended )
+				break;
+		}
+
+		if( !ended ){
+			const CardSet board = ToCardSet( table, 5 );
+			HandRank rank1 = GetHandRank( ToCardSet( cards[0], 2 ) | board );
+			HandRank rank2 = GetHandRank( ToCardSet( cards[1], 2 ) | board );
+			int res = ( rank1 > rank2 ) ? 1 : ( rank1 < rank2 ) ? -1 : 0;
+
+			if( res == 1 ){
+				mvprintw(logpos++,0,"Computer wins with a %s.", g_den[(int)GetHandType(rank1)] );
+				PrintSymbol( sCard, cards[0][0] );
+				mvprintw(logpos++,0,"Computer had: %s ", sCard);
+				PrintSymbol( sCard, cards[0][1] );
+				printw("%s\n", sCard);
+				stack[0] += pot;
+			}
+			else if( res == -1 ){
+				mvprintw(logpos++,0,"Human wins with a %s.", g_den[(int)GetHandType(rank2)] );
+				PrintSymbol( sCard, cards[0][0] );
+				mvprintw(logpos++,0,"Computer had: %s ", sCard);
+				PrintSymbol( sCard, cards[0][1] );
+				printw("%s\n", sCard);
+				stack[1] += pot;
+			}
+			else{
+				mvprintw(logpos++,0,"Both players tie a %s.", g_den[(int)GetHandType(rank2)] );
+				PrintSymbol( sCard, cards[0][0] );
+				mvprintw(logpos++,0,"Computer had: %s ", sCard);
+				PrintSymbol( sCard, cards[0][1] );
+				printw("%s\n", sCard);
+				stack[0] += pot / 2;
+				stack[1] += pot / 2;
+			}
+		}
+
+		RefreshComputerStack( stack[0] );
+		RefreshHumanStack( stack[1] );
+		RefreshPot( pot );
+
+		count++;
+
+		if( stack[0] == 0 ){
+			mvprintw(logpos++,0,"You win!\n");
+			refresh();
+			break;
+		}
+		else if( stack[1] == 0 ){
+			mvprintw(logpos++,0,"You lose!\n");
+			refresh();
+			break;
+		}
+	}
+
+	int x;
+	scanf_s( "%d", &x);
+}
+
+DWORD WINAPI tetsf( LPVOID zzz )
+{
+	double x = 0;
+	while(x < 20000000)
+	{
+		x += fabs( cos( (double)rand() ) );
+	}
+	return 0;
+}
+
+template<typename T>
+std::vector<T> GetVectorForPermutation()
+{
+	const auto n = 50;
+	const auto k = 6;
+	std::vector<T> v(n);
+	std::fill(v.begin(), v.end() - k, T(0));
+	std::fill(v.begin() + n - k, v.end(), T(1));
+	return v;
+}
+
+void Replace(std::array<Card, 5>& dstHand, const std::array<Card, 5>& srcHand)
+{
+	// memcpy rather than an int32_t cast, the cast breaks aliasing rules once the subset walk is unrolled and inlined
+	memcpy(&dstHand[0], &srcHand[0], std::tuple_size<std::decay_t<decltype(srcHand)>>::value * sizeof(std::tuple_element<0, std::decay_t<decltype(srcHand)>>::type));
+}
+
+void ReplaceIfBetter(std::array<Card, 5>& targetHand, const std::array<Card, 5>& candidateHand)
+{
+	if (CompareHands(&candidateHand[0], &targetHand[0]) == 1)
+	{
+		Replace(targetHand, candidateHand);
+	}
+}
+
+// element j of the i-th k-subset of { first, ..., n - 1 }, subsets in lexicographic order
+constexpr uint_fast8_t SubsetElement(uint32_t n, uint32_t k, uintmax_t i, uint32_t j, uint32_t first = 0)
+{
+	return (i < Combination(n - first - 1, k - 1))
+		? ((j == 0) ? static_cast<uint_fast8_t>(first) : SubsetElement(n, k - 1, i, j - 1, first + 1))
+		: SubsetElement(n, k, i - Combination(n - first - 1, k - 1), j, first + 1);
+}
+
+// Indices of every 5-card hand that can be picked among NumDeckCards cards, generated at compile time
+template <uint_fast8_t NumDeckCards>
+struct PermutationHelper
+{
+	static_assert(NumDeckCards >= 5 && NumDeckCards <= 9, "subset tables are generated for 5 to 9 cards");
+
+	static constexpr uint_fast8_t numHandCards = 5;
+	static constexpr size_t numHands = Combination(NumDeckCards, numHandCards);
+
+	typedef std::array<uint_fast8_t, numHandCards> Hand;
+
+	template <size_t... J>
+	static constexpr Hand MakeHand(size_t i, std::index_sequence<J...>)
+	{
+		return Hand{ { SubsetElement(NumDeckCards, numHandCards, i, J)... } };
+	}
+
+	template <size_t... I>
+	static constexpr std::array<Hand, numHands> MakeHands(std::index_sequence<I...>)
+	{
+		return std::array<Hand, numHands>{ { MakeHand(I, std::make_index_sequence<numHandCards>())... } };
+	}
+
+	static constexpr std::array<Hand, numHands> value = MakeHands(std::make_index_sequence<numHands>());
+};
+
+template <uint_fast8_t NumDeckCards>
+constexpr std::array<typename PermutationHelper<NumDeckCards>::Hand, PermutationHelper<NumDeckCards>::numHands> PermutationHelper<NumDeckCards>::value;
+
+template <uint_fast8_t NumDeckCards, size_t I>
+inline void ReplaceIfBetterSubset(const std::array<Card, NumDeckCards>& cards, std::array<Card, 5>& bestHand)
+{
+	typedef PermutationHelper<NumDeckCards> Helper;
+	const std::array<Card, 5> hand = { {
+		cards[Helper::value[I][0]],
+		cards[Helper::value[I][1]],
+		cards[Helper::value[I][2]],
+		cards[Helper::value[I][3]],
+		cards[Helper::value[I][4]]
+	} };
+	ReplaceIfBetter(bestHand, hand);
+}
+
+template <uint_fast8_t NumDeckCards, size_t... I>
+inline void GetBestHand(const std::array<Card, NumDeckCards>& cards, std::array<Card, 5>& bestHand, std::index_sequence<I...>)
+{
+	// one ReplaceIfBetterSubset per subset, unrolled through the pack expansion
+	const int unroll[] = { (ReplaceIfBetterSubset<NumDeckCards, I>(cards, bestHand), 0)... };
+	(void)unroll;
+}
+
+// cards must be sorted by value
+template <uint_fast8_t NumDeckCards>
+void GetBestHand(const std::array<Card, NumDeckCards>& cards, std::array<Card, 5>& bestHand)
+{
+	constexpr auto numHandCards = std::tuple_size<std::decay_t<decltype(bestHand)>>::value;
+
+	for (uint_fast8_t k = 0; k < numHandCards; ++k)
+	{
+		bestHand[k] = cards[k + NumDeckCards - numHandCards];
+	}
+
+	// NumDeckCards is given, std::array sizes are size_t and would not deduce it
+	GetBestHand<NumDeckCards>(cards, bestHand, std::make_index_sequence<PermutationHelper<NumDeckCards>::numHands>());
+}
+
+static const int32_t numThreads = 8;
+static const int32_t handsPerThread = 2500;
+
+template <typename T>
+void FastCopy(
+	decltype(declval<std:vector<T>>().cbegin())& srcBegin, 
+	decltype(declval<std:vector<T>>().cend())& srcEnd, 
+	decltype(declval<std:vector<T>>().begin())& dst)
+{
+	static auto copy = [](auto v, const T* src, T* dst) {
+		typedef decltype(v) copy_t;
+		reinterpret_cast<copy_t&>(*dst) = reinterpret_cast<const copy_t&>(*src);
+	};
+
+	uint_fast32_t totalSize = (srcEnd - srcBegin) * sizeof(T);
+	while (totalSize > 8)
+	switch (totalSize)
+	{
+	case 1:
+		copy(int8_t(), srcBegin, dst);
+		break;
+	case 2:
+		copy(int16_t(), srcBegin, dst);
+		break;
+	case 3:
+		copy(int16_t(), srcBegin, dst);
+		copy(int8_t(), srcBegin + 2, dst + 2);
+		break;
+	case 4:
+		copy(int32_t(), srcBegin, dst);
+		break;
+	case 5:
+		copy(int32_t(), srcBegin, dst);
+		copy(int8_t(), srcBegin + 4, dst + 4);
+		break;
+	case 6:
+		copy(int32_t(), srcBegin, dst);
+		copy(int16_t(), srcBegin + 4, dst + 4);
+		break;
+	case 7:
+		copy(int32_t(), srcBegin, dst);
+		copy(int16_t(), srcBegin + 4, dst + 4);
+		copy(int8_t(), srcBegin + 6, dst + 6);
+		break;
+	case 8:
+		copy(int64_t(), srcBegin, dst);
+		break;
+	}
+}
+
+// Chances split by the final HandType of each hand, each side counted from its own point of view
+struct HandTypeChances
+{
+	static const uint_fast8_t kNumHandTypes = static_cast<uint_fast8_t>(HandType::StraightFlush) + 1;
+
+	HandTypeChances& operator+=(const HandTypeChances& c)
+	{
+		for (uint_fast8_t type = 0; type < kNumHandTypes; ++type)
+		{
+			player[type] += c.player[type];
+			opponent[type] += c.opponent[type];
+		}
+		return *this;
+	}
+
+	void Add(HandRank playerRank, HandRank opponentRank, uint_fast32_t weight)
+	{
+		auto& playerChances = player[static_cast<uint_fast8_t>(GetHandType(playerRank))];
+		auto& opponentChances = opponent[static_cast<uint_fast8_t>(GetHandType(opponentRank))];
+		playerChances.total += weight;
+		opponentChances.total += weight;
+		if (playerRank > opponentRank)
+			playerChances.winning += weight;
+		else if (playerRank < opponentRank)
+			opponentChances.winning += weight;
+		else
+		{
+			playerChances.split += weight;
+			opponentChances.split += weight;
+		}
+	}
+
+	std::array<Chances, kNumHandTypes> player;
+	std::array<Chances, kNumHandTypes> opponent;
+};
+
+// stands in for HandTypeChances when nobody asked for them, compiled away
+struct NoHandTypeChances
+{
+	NoHandTypeChances& operator+=(const NoHandTypeChances&) { return *this; }
+	void Add(HandRank, HandRank, uint_fast32_t) {}
+};
+
+// the outcome of one deal, also handed to outcomes as weight deals
+template <typename Outcomes>
+static Chances ProcessTest(CardSet playerCards, CardSet opponentCards, CardSet tableCards, uint_fast32_t weight, Outcomes& outcomes)
+{
+	const auto playerRank = GetHandRank(playerCards | tableCards);
+	const auto opponentRank = GetHandRank(opponentCards | tableCards);
+	outcomes.Add(playerRank, opponentRank, weight);
+
+	Chances chances;
+	chances.total = 1;
+	chances.winning = (playerRank > opponentRank) ? 1 : 0;
+	chances.split = (playerRank == opponentRank) ? 1 : 0;
+
+	return chances;
+}
+
+// Runouts sharing everything but the last table card: both prefix states are built once and extended by each
+// of the last cards in turn.
+template <typename Outcomes>
+static Chances ProcessRunouts(CardSet playerCards, CardSet opponentCards, CardSet tableCards, CardSet lastTableCards, uint_fast32_t weight, Outcomes& outcomes)
+{
+	const HandState playerState(playerCards | tableCards);
+	const HandState opponentState(opponentCards | tableCards);
+
+	Chances chances;
+	for (auto cards = lastTableCards.mask; cards != 0; cards &= cards - 1)
+	{
+		const auto cardBit = LowestBit(cards);
+		const auto playerRank = playerState.AddBit(cardBit).Rank();
+		const auto opponentRank = opponentState.AddBit(cardBit).Rank();
+		outcomes.Add(playerRank, opponentRank, weight);
+
+		++chances.total;
+		chances.winning += (playerRank > opponentRank) ? 1 : 0;
+		chances.split += (playerRank == opponentRank) ? 1 : 0;
+	}
+
+	return chances;
+}
+
+// Complete 7-card hands waiting to be ranked together
+struct HandBatch
+{
+	static const size_t kSize = 256;
+
+	HandBatch() : size(0) {}
+
+	template <typename Outcomes>
+	void Add(CardSet playerHand, CardSet opponentHand, uint_fast32_t weight, Chances& chances, Outcomes& outcomes)
+	{
+		playerHands[size] = playerHand;
+		opponentHands[size] = opponentHand;
+		weights[size] = weight;
+		if (++size == kSize)
+			Flush(chances, outcomes);
+	}
+
+	template <typename Outcomes>
+	void Flush(Chances& chances, Outcomes& outcomes)
+	{
+		GetHandRanks7(playerHands.data(), playerRanks.data(), size);
+		GetHandRanks7(opponentHands.data(), opponentRanks.data(), size);
+		for (size_t k = 0; k < size; ++k)
+		{
+			chances.total += weights[k];
+			chances.winning += (playerRanks[k] > opponentRanks[k]) ? weights[k] : 0;
+			chances.split += (playerRanks[k] == opponentRanks[k]) ? weights[k] : 0;
+			outcomes.Add(playerRanks[k], opponentRanks[k], weights[k]);
+		}
+		size = 0;
+	}
+
+	std::array<CardSet, kSize> playerHands;
+	std::array<CardSet, kSize> opponentHands;
+	std::array<HandRank, kSize> playerRanks;
+	std::array<HandRank, kSize> opponentRanks;
+	std::array<uint_fast32_t, kSize> weights;
+	size_t size;
+};
+
+// Splits runouts sharing a table prefix by the orbit weight of their complete table under tableSymmetry, drops the
+// ones whose table is not the smallest of its orbit and hands each group over as addRunouts(table, last, weight).
+template <typename AddRunouts>
+void AddSymmetricRunouts(const SuitSymmetry& tableSymmetry, CardSet tableCards, CardSet lastTableCards, uint_fast32_t handsWeight, AddRunouts& addRunouts)
+{
+	if (tableSymmetry.IsTrivial())
+	{
+		addRunouts(tableCards, lastTableCards, handsWeight);
+	}
+	else if (lastTableCards.mask == 0)
+	{
+		const auto tableWeight = tableSymmetry.OrbitWeight(tableCards);
+		if (tableWeight != 0)
+			addRunouts(tableCards, lastTableCards, handsWeight * tableWeight);
+	}
+	else
+	{
+		// the complete tables are weighted one by one, the last cards sharing a weight still go together
+		std::array<CardSet, 25> weightedLastTableCards;
+		for (auto cards = lastTableCards.mask; cards != 0; cards &= cards - 1)
+		{
+			const auto card = cards & (0 - cards);
+			weightedLastTableCards[tableSymmetry.OrbitWeight(CardSet(tableCards.mask | card))].mask |= card;
+		}
+		for (uint_fast32_t tableWeight = 1; tableWeight < weightedLastTableCards.size(); ++tableWeight)
+		{
+			if (weightedLastTableCards[tableWeight].mask != 0)
+				addRunouts(tableCards, weightedLastTableCards[tableWeight], handsWeight * tableWeight);
+		}
+	}
+}
+
+// The GetChances enumeration addressed by index. Unit i is, in mixed radix, a player pick, an opponent pick and a
+// table prefix pick, each a subset of its options ranked in increasing order of its mask, together with the runouts
+// completing the prefix. Workers claim contiguous ranges of units and unrank only their first one, so no thread
+// feeds the others. The numbers of missing cards are compiled in, so every shape gets its own loops.
+template <uint_fast8_t NumPlayerCards, uint_fast8_t NumOpponentCards, uint_fast8_t NumTableCards,
+	uint_fast8_t MissingPlayerCards, uint_fast8_t MissingOpponentCards, uint_fast8_t MissingTableCards>
+class ChanceEnumeration
+{
+public:
+	// deadCards are out of the deck
+	ChanceEnumeration(CardSet playerCards, CardSet opponentCards, CardSet tableCards, CardSet deadCards);
+
+	uintmax_t NumUnits() const { return mNumPlayerPicks * mNumOpponentPicks * mNumTablePicks; }
+	// adds the runouts of units [begin, end) to chances and to outcomes
+	template <typename Outcomes>
+	void Process(uintmax_t begin, uintmax_t end, Chances& chances, Outcomes& outcomes) const;
+	void Process(uintmax_t begin, uintmax_t end, Chances& chances) const
+	{
+		NoHandTypeChances outcomes;
+		Process(begin, end, chances, outcomes);
+	}
+	Chances Run() const
+	{
+		NoHandTypeChances outcomes;
+		return Run(outcomes);
+	}
+	// also splits the results by hand type into handTypeChances
+	Chances Run(HandTypeChances& handTypeChances) const
+	{
+		return Run<HandTypeChances>(handTypeChances);
+	}
+
+private:
+	template <typename Outcomes>
+	Chances Run(Outcomes& outcomes) const;
+
+	static const uint_fast8_t kNumCards = CardSet::kColorShift * static_cast<uint_fast8_t>(CardColor::Count);
+	// the last missing table card is not picked: the runouts differing only by it are evaluated together
+	static const uint_fast8_t kPrefixTableCards = (MissingTableCards > 0) ? MissingTableCards - 1 : 0;
+	// a k-subset of n options is a mask over their n lowest bits, ranked as in UnrankSubset
+	static bool Next(uint64_t& subset, uint_fast8_t numOptions)
+	{
+		if (subset == 0)
+			return false;
+		const auto next = NextSubsetMask(subset);
+		if ((next >> numOptions) != 0)
+			return false;
+		subset = next;
+		return true;
+	}
+	static uint64_t First(uint_fast8_t size)
+	{
+		return (uint64_t(1) << size) - 1;
+	}
+	static CardSet Pick(uint64_t options, uint64_t subset)
+	{
+		return CardSet(DepositBits(subset, options));
+	}
+
+	CardSet mKnownPlayerCards;
+	CardSet mKnownOpponentCards;
+	CardSet mKnownTableCards;
+	SuitSymmetry mKnownSymmetry;
+	uint64_t mPlayerOptions;
+	uint_fast8_t mNumPlayerOptions;
+	uint_fast8_t mNumOpponentOptions;
+	uint_fast8_t mNumTableOptions;
+	uintmax_t mNumPlayerPicks;
+	uintmax_t mNumOpponentPicks;
+	uintmax_t mNumTablePicks;
+};
+
+template <uint_fast8_t NumPlayerCards, uint_fast8_t NumOpponentCards, uint_fast8_t NumTableCards,
+	uint_fast8_t MissingPlayerCards, uint_fast8_t MissingOpponentCards, uint_fast8_t MissingTableCards>
+ChanceEnumeration<NumPlayerCards, NumOpponentCards, NumTableCards, MissingPlayerCards, MissingOpponentCards, MissingTableCards>::ChanceEnumeration(
+	CardSet playerCards, CardSet opponentCards, CardSet tableCards, CardSet deadCards)
+	: mKnownPlayerCards(playerCards)
+	, mKnownOpponentCards(opponentCards)
+	, mKnownTableCards(tableCards)
+{
+	assert(playerCards.Size() + MissingPlayerCards == NumPlayerCards);
+	assert(opponentCards.Size() + MissingOpponentCards == NumOpponentCards);
+	assert(tableCards.Size() + MissingTableCards == NumTableCards);
+
+	mKnownSymmetry = SuitSymmetry().Stabilizer(mKnownPlayerCards).Stabilizer(mKnownOpponentCards).Stabilizer(mKnownTableCards).Stabilizer(deadCards);
+	mPlayerOptions = ((uint64_t(1) << kNumCards) - 1) & ~(mKnownPlayerCards | mKnownOpponentCards | mKnownTableCards | deadCards).mask;
+
+	mNumPlayerOptions = PopCount(mPlayerOptions);
+	mNumOpponentOptions = mNumPlayerOptions - MissingPlayerCards;
+	mNumTableOptions = mNumOpponentOptions - MissingOpponentCards - ((MissingTableCards > 0) ? 1 : 0);
+
+	mNumPlayerPicks = Combination(mNumPlayerOptions, MissingPlayerCards);
+	mNumOpponentPicks = Combination(mNumOpponentOptions, MissingOpponentCards);
+	mNumTablePicks = Combination(mNumTableOptions, kPrefixTableCards);
+}
+
+template <uint_fast8_t NumPlayerCards, uint_fast8_t NumOpponentCards, uint_fast8_t NumTableCards,
+	uint_fast8_t MissingPlayerCards, uint_fast8_t MissingOpponentCards, uint_fast8_t MissingTableCards>
+template <typename Outcomes>
+void ChanceEnumeration<NumPlayerCards, NumOpponentCards, NumTableCards, MissingPlayerCards, MissingOpponentCards, MissingTableCards>::Process(uintmax_t begin, uintmax_t end, Chances& chances, Outcomes& outcomes) const
+{
+	const uintmax_t tableBlock = mNumTablePicks;
+	const uintmax_t opponentBlock = mNumOpponentPicks * tableBlock;
+
+	uint64_t playerSubset = UnrankSubset(begin / opponentBlock, MissingPlayerCards, mNumPlayerOptions);
+	uint64_t opponentSubset = UnrankSubset(begin / tableBlock % mNumOpponentPicks, MissingOpponentCards, mNumOpponentOptions);
+	uint64_t tableSubset = UnrankSubset(begin % tableBlock, kPrefixTableCards, mNumTableOptions);
+
+	HandBatch batch;
+	uintmax_t unit = begin;
+	while (unit < end)
+	{
+		// each level only deals the smallest pick of every orbit, weighted by the orbit size
+		const CardSet playerPick = Pick(mPlayerOptions, playerSubset);
+		const CardSet innerPlayerCards = mKnownPlayerCards | playerPick;
+		const auto playerWeight = mKnownSymmetry.OrbitWeight(innerPlayerCards);
+		if (playerWeight == 0)
+		{
+			unit = (unit / opponentBlock + 1) * opponentBlock;
+		}
+		else
+		{
+			const auto playerSymmetry = mKnownSymmetry.Stabilizer(innerPlayerCards);
+			const uint64_t opponentOptions = mPlayerOptions & ~playerPick.mask;
+
+			do {
+				const CardSet opponentPick = Pick(opponentOptions, opponentSubset);
+				const CardSet innerOpponentCards = mKnownOpponentCards | opponentPick;
+				const auto opponentWeight = playerSymmetry.OrbitWeight(innerOpponentCards);
+				if (opponentWeight == 0)
+				{
+					unit = (unit / tableBlock + 1) * tableBlock;
+				}
+				else
+				{
+					const auto tableSymmetry = playerSymmetry.Stabilizer(innerOpponentCards);
+					const uint64_t tableOptions = opponentOptions & ~opponentPick.mask;
+
+					auto addRunouts = [&](CardSet innerTableCards, CardSet innerLastTableCards, uint_fast32_t weight) {
+						if (innerLastTableCards.mask != 0)
+						{
+							chances += ProcessRunouts(innerPlayerCards, innerOpponentCards, innerTableCards, innerLastTableCards, weight, outcomes) * weight;
+						}
+						else if (NumPlayerCards + NumTableCards == 7 && NumOpponentCards + NumTableCards == 7)
+						{
+							batch.Add(innerPlayerCards | innerTableCards, innerOpponentCards | innerTableCards, weight, chances, outcomes);
+						}
+						else
+						{
+							chances += ProcessTest(innerPlayerCards, innerOpponentCards, innerTableCards, weight, outcomes) * weight;
+						}
+					};
+
+					do {
+						// the prefix comes from the lowest table options, the last card from the ones above it
+						const CardSet tablePick = Pick(tableOptions, tableSubset);
+						const CardSet innerTableCards = mKnownTableCards | tablePick;
+						const CardSet innerLastTableCards((MissingTableCards > 0) ? tableOptions & BitsAbove(tablePick.mask) : 0);
+						AddSymmetricRunouts(tableSymmetry, innerTableCards, innerLastTableCards, playerWeight * opponentWeight, addRunouts);
+						++unit;
+					} while (unit < end && Next(tableSubset, mNumTableOptions));
+				}
+				tableSubset = First(kPrefixTableCards);
+			} while (unit < end && Next(opponentSubset, mNumOpponentOptions));
+		}
+		opponentSubset = First(MissingOpponentCards);
+		tableSubset = First(kPrefixTableCards);
+		if (!Next(playerSubset, mNumPlayerOptions))
+			break;
+	}
+	batch.Flush(chances, outcomes);
+}
+
+template <uint_fast8_t NumPlayerCards, uint_fast8_t NumOpponentCards, uint_fast8_t NumTableCards,
+	uint_fast8_t MissingPlayerCards, uint_fast8_t MissingOpponentCards, uint_fast8_t MissingTableCards>
+template <typename Outcomes>
+Chances ChanceEnumeration<NumPlayerCards, NumOpponentCards, NumTableCards, MissingPlayerCards, MissingOpponentCards, MissingTableCards>::Run(Outcomes& outcomes) const
+{
+	auto& pool = ThreadPool::Get();
+	const auto numUnits = NumUnits();
+	// ranges small enough to even out the orbits skipped unevenly along the way
+	const uintmax_t rangeSize = MAX(numUnits / ((pool.NumThreads() + 1) * 64), uintmax_t(1));
+
+	std::mutex resultMutex;
+	Chances chances;
+	pool.ParallelFor(numUnits, rangeSize, [&](uint64_t begin, uint64_t end) {
+		// counted apart by every range, merged once it is done
+		Chances rangeChances;
+		Outcomes rangeOutcomes;
+		Process(begin, end, rangeChances, rangeOutcomes);
+
+		std::lock_guard<std::mutex> lk(resultMutex);
+		chances += rangeChances;
+		outcomes += rangeOutcomes;
+	});
+
+	return chances;
+}
+
+// GETCHANCES_BY_TABLE: hold'em queries with both hands incomplete enumerate the tables first
+#define GETCHANCES_BY_TABLE
+
+Chances GetChancesByTable(CardSet playerCards, CardSet opponentCards, CardSet tableCards, CardSet deadCards);
+
+// A GetChances query whose sizes are only known at run time
+struct ChanceQuery
+{
+	ChanceQuery() : numPlayerCards(2), numOpponentCards(2), numTableCards(5) {}
+
+	// the hand and table sizes once complete
+	uint_fast8_t numPlayerCards;
+	uint_fast8_t numOpponentCards;
+	uint_fast8_t numTableCards;
+	// the known cards, and the ones out of the deck
+	CardSet playerCards;
+	CardSet opponentCards;
+	CardSet tableCards;
+	CardSet deadCards;
+};
+
+// GetChances compiled for one shape: the sizes, and how many cards of each are missing
+template <uint_fast8_t NumPlayerCards, uint_fast8_t NumOpponentCards, uint_fast8_t NumTableCards,
+	uint_fast8_t MissingPlayerCards, uint_fast8_t MissingOpponentCards, uint_fast8_t MissingTableCards>
+Chances GetChancesOfShape(CardSet playerCards, CardSet opponentCards, CardSet tableCards, CardSet deadCards, HandTypeChances* handTypeChances)
+{
+	// only the enumeration dealing hands first sees the hand types of both sides
+	if (handTypeChances != nullptr)
+	{
+		const ChanceEnumeration<NumPlayerCards, NumOpponentCards, NumTableCards, MissingPlayerCards, MissingOpponentCards, MissingTableCards>
+			enumeration(playerCards, opponentCards, tableCards, deadCards);
+		return enumeration.Run(*handTypeChances);
+	}
+
+	// a hand against any holding on a complete table, or a table missing the river: one table of ranked holdings
+	// per river answers it
+	if (NumPlayerCards == 2 && NumOpponentCards == 2 && NumTableCards == 5 && MissingTableCards <= 1
+		&& MissingPlayerCards + MissingOpponentCards == 2 && (MissingPlayerCards == 0 || MissingOpponentCards == 0))
+	{
+		const auto handCards = (MissingOpponentCards == 2) ? playerCards : opponentCards;
+		auto chances = (MissingTableCards == 0)
+			? RiverRankTable(tableCards, deadCards).GetChances(handCards)
+			: GetTurnChances(handCards, tableCards, deadCards);
+		if (MissingOpponentCards == 2)
+			return chances;
+
+		// the opponent's wins are the player's losses
+		chances.winning = chances.total - chances.winning - chances.split;
+		return chances;
+	}
+
+#ifdef GETCHANCES_BY_TABLE
+	// ranking every table once beats ranking it again under each pair of completions
+	if (NumPlayerCards == 2 && NumOpponentCards == 2 && NumTableCards == 5 && MissingPlayerCards > 0 && MissingOpponentCards > 0)
+	{
+		return GetChancesByTable(playerCards, opponentCards, tableCards, deadCards);
+	}
+#endif
+
+	const ChanceEnumeration<NumPlayerCards, NumOpponentCards, NumTableCards, MissingPlayerCards, MissingOpponentCards, MissingTableCards>
+		enumeration(playerCards, opponentCards, tableCards, deadCards);
+	return enumeration.Run();
+}
+
+typedef Chances (*ChancesFunction)(CardSet playerCards, CardSet opponentCards, CardSet tableCards, CardSet deadCards, HandTypeChances* handTypeChances);
+
+// GetChancesOfShape for every count of missing cards of a shape, at index
+// (missingPlayerCards * (NumOpponentCards + 1) + missingOpponentCards) * (NumTableCards + 1) + missingTableCards
+template <uint_fast8_t NumPlayerCards, uint_fast8_t NumOpponentCards, uint_fast8_t NumTableCards, size_t... Indices>
+std::array<ChancesFunction, sizeof...(Indices)> MakeChancesFunctions(std::index_sequence<Indices...>)
+{
+	return {{&GetChancesOfShape<NumPlayerCards, NumOpponentCards, NumTableCards,
+		static_cast<uint_fast8_t>(Indices / (NumTableCards + 1) / (NumOpponentCards + 1)),
+		static_cast<uint_fast8_t>(Indices / (NumTableCards + 1) % (NumOpponentCards + 1)),
+		static_cast<uint_fast8_t>(Indices % (NumTableCards + 1))>...}};
+}
+
+template <uint_fast8_t NumPlayerCards, uint_fast8_t NumOpponentCards, uint_fast8_t NumTableCards>
+const ChancesFunction* ChancesFunctions()
+{
+	static const auto functions = MakeChancesFunctions<NumPlayerCards, NumOpponentCards, NumTableCards>(
+		std::make_index_sequence<(NumPlayerCards + 1) * (NumOpponentCards + 1) * (NumTableCards + 1)>());
+	return functions.data();
+}
+
+// the ones for two hold'em hands and NumTableCards table cards
+template <uint_fast8_t NumTableCards>
+const ChancesFunction* HoldemChancesFunctions()
+{
+	return ChancesFunctions<2, 2, NumTableCards>();
+}
+
+// The index of the GetChancesOfShape of a query in ChancesFunctions of its sizes. False for cards given twice, more
+// known cards than the sizes hold or a deck too short.
+static bool GetShapeIndex(const ChanceQuery& query, size_t& shapeIndex)
+{
+	static const uint_fast8_t kNumCards = CardSet::kColorShift * static_cast<uint_fast8_t>(CardColor::Count);
+
+	const auto numKnownPlayerCards = query.playerCards.Size();
+	const auto numKnownOpponentCards = query.opponentCards.Size();
+	const auto numKnownTableCards = query.tableCards.Size();
+	if (numKnownPlayerCards > query.numPlayerCards || numKnownOpponentCards > query.numOpponentCards || numKnownTableCards > query.numTableCards)
+		return false;
+
+	const auto allCards = query.playerCards | query.opponentCards | query.tableCards | query.deadCards;
+	const auto numGivenCards = numKnownPlayerCards + numKnownOpponentCards + numKnownTableCards + query.deadCards.Size();
+	const auto numMissingCards = query.numPlayerCards + query.numOpponentCards + query.numTableCards - numKnownPlayerCards - numKnownOpponentCards - numKnownTableCards;
+	if (allCards.Size() != numGivenCards || (allCards.mask >> kNumCards) != 0 || numGivenCards + numMissingCards > kNumCards)
+		return false;
+
+	const auto missingPlayerCards = query.numPlayerCards - numKnownPlayerCards;
+	const auto missingOpponentCards = query.numOpponentCards - numKnownOpponentCards;
+	const auto missingTableCards = query.numTableCards - numKnownTableCards;
+	shapeIndex = (missingPlayerCards * (query.numOpponentCards + 1) + missingOpponentCards) * (query.numTableCards + 1) + missingTableCards;
+	return true;
+}
+
+// GetShapeIndex of a query of two hold'em hands and a flop, turn or river table, whose functions are compiled for
+// queries read at run time. False for other sizes as well.
+static bool GetHoldemShapeIndex(const ChanceQuery& query, size_t& shapeIndex)
+{
+	static const uint_fast8_t kNumHoleCards = 2;
+	static const uint_fast8_t kMinTableCards = 3;
+	static const uint_fast8_t kMaxTableCards = 5;
+
+	if (query.numPlayerCards != kNumHoleCards || query.numOpponentCards != kNumHoleCards
+		|| query.numTableCards < kMinTableCards || query.numTableCards > kMaxTableCards)
+		return false;
+	return GetShapeIndex(query, shapeIndex);
+}
+
+// GetChances of a query read at run time, handed to the enumeration compiled for its shape; nothing for a query
+// GetHoldemShapeIndex turns down. When handTypeChances is given, the results are also split into it by hand type.
+static Chances GetChances(const ChanceQuery& query, HandTypeChances* handTypeChances)
+{
+	size_t shapeIndex;
+	if (!GetHoldemShapeIndex(query, shapeIndex))
+		return Chances();
+
+	static const ChancesFunction* const functions[] = {
+		HoldemChancesFunctions<3>(),
+		HoldemChancesFunctions<4>(),
+		HoldemChancesFunctions<5>(),
+	};
+	const auto function = functions[query.numTableCards - 3][shapeIndex];
+	return function(query.playerCards, query.opponentCards, query.tableCards, query.deadCards, handTypeChances);
+}
+
+Chances GetChances(const ChanceQuery& query)
+{
+	return GetChances(query, nullptr);
+}
+
+Chances GetChances(const ChanceQuery& query, HandTypeChances& handTypeChances)
+{
+	handTypeChances = HandTypeChances();
+	return GetChances(query, &handTypeChances);
+}
+
+// The ChanceQuery of cards given as vectors to a query of NumPlayerCards, NumOpponentCards and NumTableCards, and
+// its GetShapeIndex. False for a card given twice in a vector, and whatever GetShapeIndex rejects.
+template <uint_fast8_t NumPlayerCards, uint_fast8_t NumOpponentCards, uint_fast8_t NumTableCards>
+bool GetChanceQuery(const std::vector<Card>& playerCards, const std::vector<Card>& opponentCards, const std::vector<Card>& tableCards,
+	const std::vector<Card>& deadCards, ChanceQuery& query, size_t& shapeIndex)
+{
+	query.numPlayerCards = NumPlayerCards;
+	query.numOpponentCards = NumOpponentCards;
+	query.numTableCards = NumTableCards;
+	query.playerCards = CardSet(playerCards.data(), playerCards.size());
+	query.opponentCards = CardSet(opponentCards.data(), opponentCards.size());
+	query.tableCards = CardSet(tableCards.data(), tableCards.size());
+	query.deadCards = CardSet(deadCards.data(), deadCards.size());
+
+	return query.playerCards.Size() == playerCards.size() && query.opponentCards.Size() == opponentCards.size()
+		&& query.tableCards.Size() == tableCards.size() && query.deadCards.Size() == deadCards.size() && GetShapeIndex(query, shapeIndex);
+}
+
+template <uint_fast8_t NumPlayerCards, uint_fast8_t NumOpponentCards, uint_fast8_t NumTableCards>
+Chances GetChances(const std::vector<Card>& playerCards, const std::vector<Card>& opponentCards, const std::vector<Card>& tableCards,
+	const std::vector<Card>& deadCards = std::vector<Card>())
+{
+	static_assert(NumPlayerCards + NumTableCards >= 5 && NumPlayerCards + NumTableCards <= 7
+		&& NumOpponentCards + NumTableCards >= 5 && NumOpponentCards + NumTableCards <= 7, "hands of 5 to 7 cards");
+
+	// the shape is known here, so any shape the evaluator ranks works, not only the ones compiled for run time
+	ChanceQuery query;
+	size_t shapeIndex;
+	if (!GetChanceQuery<NumPlayerCards, NumOpponentCards, NumTableCards>(playerCards, opponentCards, tableCards, deadCards, query, shapeIndex))
+		return Chances();
+	const auto function = ChancesFunctions<NumPlayerCards, NumOpponentCards, NumTableCards>()[shapeIndex];
+	return function(query.playerCards, query.opponentCards, query.tableCards, query.deadCards, nullptr);
+}
+
+// GetChances of many queries at once. Queries equal up to a suit permutation, or to swapping two hands of the same
+// size, are evaluated once; the distinct ones run as pool tasks, each splitting its own enumeration further.
+// The results come in the order of the queries.
+std::vector<Chances> GetChances(const std::vector<ChanceQuery>& queries)
+{
+	typedef std::tuple<uint_fast8_t, uint_fast8_t, uint_fast8_t, uint64_t, uint64_t, uint64_t, uint64_t> QueryKey;
+	static const uint_fast8_t kNumCards = CardSet::kColorShift * static_cast<uint_fast8_t>(CardColor::Count);
+
+	const SuitSymmetry suitPermutations;
+	auto queryKey = [](const ChanceQuery& query) {
+		return QueryKey(query.numPlayerCards, query.numOpponentCards, query.numTableCards,
+			query.playerCards.mask, query.opponentCards.mask, query.tableCards.mask, query.deadCards.mask);
+	};
+
+	std::map<QueryKey, size_t> uniqueIndices;
+	std::vector<ChanceQuery> uniqueQueries;
+	// the unique query of each query, and whether its hands were swapped
+	std::vector<std::pair<size_t, bool>> sources(queries.size());
+	for (size_t k = 0; k < queries.size(); ++k)
+	{
+		const auto& query = queries[k];
+		ChanceQuery canonical = query;
+		bool swapped = false;
+
+		// queries with cards off the deck are left as they are, GetChances turns them down
+		const auto allCards = query.playerCards | query.opponentCards | query.tableCards | query.deadCards;
+		if ((allCards.mask >> kNumCards) == 0)
+		{
+			ChanceQuery swappedQuery = query;
+			std::swap(swappedQuery.numPlayerCards, swappedQuery.numOpponentCards);
+			std::swap(swappedQuery.playerCards, swappedQuery.opponentCards);
+			const bool canSwap = query.numPlayerCards == query.numOpponentCards;
+
+			auto canonicalKey = queryKey(canonical);
+			for (const auto& permutation : suitPermutations)
+			{
+				for (uint_fast8_t swapHands = 0; swapHands < (canSwap ? 2 : 1); ++swapHands)
+				{
+					const auto& source = swapHands ? swappedQuery : query;
+					ChanceQuery image = source;
+					image.playerCards = SuitSymmetry::Apply(source.playerCards, permutation);
+					image.opponentCards = SuitSymmetry::Apply(source.opponentCards, permutation);
+					image.tableCards = SuitSymmetry::Apply(source.tableCards, permutation);
+					image.deadCards = SuitSymmetry::Apply(source.deadCards, permutation);
+					const auto imageKey = queryKey(image);
+					if (imageKey < canonicalKey)
+					{
+						canonical = image;
+						canonicalKey = imageKey;
+						swapped = swapHands != 0;
+					}
 				}
-				RefreshComputerStack( stack[0] );
-				RefreshPot( pot );
 			}
-
-			if( ended )
-				break;
 		}
 
-		if( !ended ){
-			byte tstcards[7];
-			byte bestHand1[5];
-			byte bestHand2[5];
-			tstcards[2] = table[0];
-			tstcards[3] = table[1];
-			tstcards[4] = table[2];
-			tstcards[5] = table[3];
-			tstcards[6] = table[4];
-			tstcards[0] = cards[0][0];
-			tstcards[1] = cards[0][1];
-			GetBestHand( tstcards, 7, bestHand1 );
-			tstcards[0] = cards[1][0];
-			tstcards[1] = cards[1][1];
-			GetBestHand( tstcards, 7, bestHand2 );
-			int res = CompareHands( bestHand1, bestHand2 );
+		const auto inserted = uniqueIndices.insert(std::make_pair(queryKey(canonical), uniqueQueries.size()));
+		if (inserted.second)
+			uniqueQueries.push_back(canonical);
+		sources[k] = std::make_pair(inserted.first->second, swapped);
+	}
 
-			if( res == 1 ){
-				mvprintw(logpos++,0,"Computer wins with a %s.", g_den[(int)GetHandType(bestHand1)] );
-				PrintSymbol( sCard, cards[0][0] );
-				mvprintw(logpos++,0,"Computer had: %s ", sCard);
-				PrintSymbol( sCard, cards[0][1] );
-				printw("%s\n", sCard);
-				stack[0] += pot;
-			}
-			else if( res == -1 ){
-				mvprintw(logpos++,0,"Human wins with a %s.", g_den[(int)GetHandType(bestHand2)] );
-				PrintSymbol( sCard, cards[0][0] );
-				mvprintw(logpos++,0,"Computer had: %s ", sCard);
-				PrintSymbol( sCard, cards[0][1] );
-				printw("%s\n", sCard);
-				stack[1] += pot;
-			}
-			else{
-				mvprintw(logpos++,0,"Both players tie a %s.", g_den[(int)GetHandType(bestHand2)] );
-				PrintSymbol( sCard, cards[0][0] );
-				mvprintw(logpos++,0,"Computer had: %s ", sCard);
-				PrintSymbol( sCard, cards[0][1] );
-				printw("%s\n", sCard);
-				stack[0] += pot / 2;
-				stack[1] += pot / 2;
-			}
+	std::vector<Chances> uniqueResults(uniqueQueries.size());
+	ThreadPool::Get().ParallelFor(uniqueQueries.size(), 1, [&](uint64_t begin, uint64_t end) {
+		for (auto k = begin; k < end; ++k)
+		{
+			uniqueResults[k] = GetChances(uniqueQueries[k]);
 		}
+	});
 
-		RefreshComputerStack( stack[0] );
-		RefreshHumanStack( stack[1] );
-		RefreshPot( pot );
+	std::vector<Chances> results(queries.size());
+	for (size_t k = 0; k < queries.size(); ++k)
+	{
+		results[k] = uniqueResults[sources[k].first];
+		// the opponent's wins are the player's losses
+		if (sources[k].second)
+			results[k].winning = results[k].total - results[k].winning - results[k].split;
+	}
+	return results;
+}
 
-		count++;
+// The units of a ChanceEnumeration whose shape is only known at run time
+class ChanceUnits
+{
+public:
+	virtual ~ChanceUnits() {}
 
-		if( stack[0] == 0 ){
-			mvprintw(logpos++,0,"You win!\n");
-			refresh();
-			break;
-		}
-		else if( stack[1] == 0 ){
-			mvprintw(logpos++,0,"You lose!\n");
-			refresh();
-			break;
-		}
+	virtual uintmax_t NumUnits() const = 0;
+	// adds the runouts of units [begin, end) to chances
+	virtual void Process(uintmax_t begin, uintmax_t end, Chances& chances) const = 0;
+};
+
+template <uint_fast8_t NumPlayerCards, uint_fast8_t NumOpponentCards, uint_fast8_t NumTableCards,
+	uint_fast8_t MissingPlayerCards, uint_fast8_t MissingOpponentCards, uint_fast8_t MissingTableCards>
+class ChanceEnumerationUnits : public ChanceUnits
+{
+public:
+	ChanceEnumerationUnits(CardSet playerCards, CardSet opponentCards, CardSet tableCards, CardSet deadCards)
+		: mEnumeration(playerCards, opponentCards, tableCards, deadCards)
+	{}
+
+	uintmax_t NumUnits() const override { return mEnumeration.NumUnits(); }
+	void Process(uintmax_t begin, uintmax_t end, Chances& chances) const override { mEnumeration.Process(begin, end, chances); }
+
+	static std::unique_ptr<ChanceUnits> Make(CardSet playerCards, CardSet opponentCards, CardSet tableCards, CardSet deadCards)
+	{
+		return std::unique_ptr<ChanceUnits>(new ChanceEnumerationUnits(playerCards, opponentCards, tableCards, deadCards));
 	}
 
-	int x;
-	scanf_s( "%d", &x);
+private:
+	ChanceEnumeration<NumPlayerCards, NumOpponentCards, NumTableCards, MissingPlayerCards, MissingOpponentCards, MissingTableCards> mEnumeration;
+};
+
+typedef std::unique_ptr<ChanceUnits> (*ChanceUnitsFunction)(CardSet playerCards, CardSet opponentCards, CardSet tableCards, CardSet deadCards);
+
+// ChanceEnumerationUnits::Make at the indices of HoldemChancesFunctions
+template <uint_fast8_t NumTableCards, size_t... Indices>
+std::array<ChanceUnitsFunction, sizeof...(Indices)> MakeHoldemChanceUnitsFunctions(std::index_sequence<Indices...>)
+{
+	return {{&ChanceEnumerationUnits<2, 2, NumTableCards,
+		static_cast<uint_fast8_t>(Indices / (NumTableCards + 1) / 3),
+		static_cast<uint_fast8_t>(Indices / (NumTableCards + 1) % 3),
+		static_cast<uint_fast8_t>(Indices % (NumTableCards + 1))>::Make...}};
 }
 
-DWORD WINAPI tetsf( LPVOID zzz )
+template <uint_fast8_t NumTableCards>
+const ChanceUnitsFunction* HoldemChanceUnitsFunctions()
 {
-	double x = 0;
-	while(x < 20000000)
+	static const auto functions = MakeHoldemChanceUnitsFunctions<NumTableCards>(std::make_index_sequence<3 * 3 * (NumTableCards + 1)>());
+	return functions.data();
+}
+
+// How far a ChanceJob got
+struct ChanceProgress
+{
+	ChanceProgress() : numDeals(0), numUnitsDone(0), numUnits(0), remainingMs(0), finished(false) {}
+
+	// units stand for deals unevenly, the ones skipped by the suit symmetry for none, so progress counts deals
+	double Done() const { return (numDeals > 0) ? static_cast<double>(chances.total) / numDeals : 1; }
+	bool Exact() const { return numUnitsDone == numUnits; }
+
+	// the chances of the deals done, and scaled up to all numDeals of them
+	Chances chances;
+	Chances estimate;
+	uintmax_t numDeals;
+	uintmax_t numUnitsDone;
+	uintmax_t numUnits;
+	// the time left at the pace so far
+	double remainingMs;
+	// no more units will be done: all of them are, or the job was cancelled or ran out of time
+	bool finished;
+};
+
+// GetChances of a query run in the background by the pool threads, polled for its chances so far. The units of its
+// ChanceEnumeration are split into blocks visited in bit-reversed order, so the blocks done at any time are spread
+// evenly over the enumeration; their chances are scaled up to the number of deals, known in advance. Every pool task
+// claims a few blocks in that order and returns, so other pool work runs in between. No more blocks are started
+// once the job is cancelled, by Cancel or through cancelToken, or past its deadline.
+class ChanceJob
+{
+public:
+	typedef std::chrono::steady_clock Clock;
+
+	explicit ChanceJob(const ChanceQuery& query, Clock::time_point deadline = Clock::time_point::max(),
+		const std::atomic<bool>* cancelToken = nullptr);
+	// cancels the job and waits for the blocks running
+	~ChanceJob();
+
+	ChanceProgress Poll() const;
+	void Cancel() { mCancelled = true; }
+	// runs blocks of the job, or other pool tasks, until it finishes
+	ChanceProgress Wait();
+
+private:
+	// about as many blocks, enough for an even spread and few enough to keep each worth a claim
+	static const uint_fast32_t kNumBlocks = 65536;
+	// at most as many pool tasks, each claiming its share of the blocks, well within the pool's task rings
+	static const uint_fast32_t kMaxTasks = 256;
+
+	ChanceJob(const ChanceJob&);
+	ChanceJob& operator=(const ChanceJob&);
+
+	void Run();
+	bool Stopping() const
 	{
-		x += fabs( cos( (double)rand() ) );
+		return mCancelled || (mCancelToken != nullptr && *mCancelToken) || Clock::now() >= mDeadline;
 	}
-	return 0;
-}
 
-template<typename T>
-std::vector<T> GetVectorForPermutation()
+	std::unique_ptr<ChanceUnits> mUnits;
+	Clock::time_point mStart;
+	Clock::time_point mDeadline;
+	const std::atomic<bool>* mCancelToken;
+	std::atomic<bool> mCancelled;
+	uintmax_t mNumDeals;
+	uintmax_t mNumUnits;
+	uintmax_t mBlockSize;
+	uintmax_t mNumBlocks;
+	// the blocks in visiting order are the bit reversals of 0 to 2^mOrderBits - 1, the ones past mNumBlocks skipped
+	uint_fast8_t mOrderBits;
+	uint64_t mOrdersPerTask;
+	std::atomic<uint64_t> mNextOrder;
+	ThreadPool::TaskGroup mGroup;
+
+	mutable std::mutex mResultMutex;
+	Chances mChances;
+	uintmax_t mNumUnitsDone;
+};
+
+ChanceJob::ChanceJob(const ChanceQuery& query, Clock::time_point deadline, const std::atomic<bool>* cancelToken)
+	: mStart(Clock::now())
+	, mDeadline(deadline)
+	, mCancelToken(cancelToken)
+	, mCancelled(false)
+	, mNumDeals(0)
+	, mNumUnits(0)
+	, mBlockSize(1)
+	, mNumBlocks(0)
+	, mOrderBits(0)
+	, mOrdersPerTask(0)
+	, mNextOrder(0)
+	, mNumUnitsDone(0)
 {
-	const auto n = 50;
-	const auto k = 6;
-	std::vector<T> v(n);
-	std::fill(v.begin(), v.end() - k, T(0));
-	std::fill(v.begin() + n - k, v.end(), T(1));
-	return v;
+	size_t shapeIndex;
+	if (!GetHoldemShapeIndex(query, shapeIndex))
+		return;
+
+	static const ChanceUnitsFunction* const functions[] = {
+		HoldemChanceUnitsFunctions<3>(),
+		HoldemChanceUnitsFunctions<4>(),
+		HoldemChanceUnitsFunctions<5>(),
+	};
+	mUnits = functions[query.numTableCards - 3][shapeIndex](query.playerCards, query.opponentCards, query.tableCards, query.deadCards);
+	mNumUnits = mUnits->NumUnits();
+	mBlockSize = MAX(mNumUnits / kNumBlocks, uintmax_t(1));
+	mNumBlocks = (mNumUnits + mBlockSize - 1) / mBlockSize;
+	while ((uintmax_t(1) << mOrderBits) < mNumBlocks)
+		++mOrderBits;
+
+	static const uint32_t kNumCards = CardSet::kColorShift * static_cast<uint_fast8_t>(CardColor::Count);
+	const uint32_t numLiveCards = kNumCards - (query.playerCards | query.opponentCards | query.tableCards | query.deadCards).Size();
+	const uint32_t missingPlayerCards = query.numPlayerCards - query.playerCards.Size();
+	const uint32_t missingOpponentCards = query.numOpponentCards - query.opponentCards.Size();
+	const uint32_t missingTableCards = query.numTableCards - query.tableCards.Size();
+	mNumDeals = Combination(numLiveCards, missingPlayerCards)
+		* Combination(numLiveCards - missingPlayerCards, missingOpponentCards)
+		* Combination(numLiveCards - missingPlayerCards - missingOpponentCards, missingTableCards);
+
+	const uint64_t numOrders = uint64_t(1) << mOrderBits;
+	const uint64_t numTasks = MIN(numOrders, uint64_t(kMaxTasks));
+	mOrdersPerTask = (numOrders + numTasks - 1) / numTasks;
+	auto& pool = ThreadPool::Get();
+	for (uint64_t k = 0; k < numTasks; ++k)
+	{
+		pool.Submit(mGroup, [this]() { Run(); });
+	}
 }
 
-void Replace(std::array<Card, 5>& dstHand, const std::array<Card, 5>& srcHand)
+ChanceJob::~ChanceJob()
 {
-	reinterpret_cast<int32_t&>(dstHand[0]) = reinterpret_cast<const int32_t&>(srcHand[0]);
-	dstHand[4] = srcHand[4];
-	//memcpy(&dstHand[0], &srcHand[0], std::tuple_size<std::decay_t<decltype(srcHand)>>::value * sizeof(std::tuple_element<0, std::decay_t<decltype(srcHand)>>::type));
+	Cancel();
+	ThreadPool::Get().Wait(mGroup);
 }
 
-void ReplaceIfBetter(std::array<Card, 5>& targetHand, const std::array<Card, 5>& candidateHand)
+void ChanceJob::Run()
 {
-	if (CompareHands(&candidateHand[0], &targetHand[0]) == 1)
+	const uint64_t numOrders = uint64_t(1) << mOrderBits;
+	for (uint64_t k = 0; k < mOrdersPerTask && !Stopping(); ++k)
 	{
-		Replace(targetHand, candidateHand);
+		const uint64_t order = mNextOrder++;
+		if (order >= numOrders)
+			break;
+
+		uint64_t block = 0;
+		for (uint_fast8_t bit = 0; bit < mOrderBits; ++bit)
+			block |= (order >> bit & 1) << (mOrderBits - 1 - bit);
+		if (block >= mNumBlocks)
+			continue;
+
+		const uintmax_t begin = block * mBlockSize;
+		const uintmax_t end = MIN(begin + mBlockSize, mNumUnits);
+		Chances blockChances;
+		mUnits->Process(begin, end, blockChances);
+
+		std::lock_guard<std::mutex> lk(mResultMutex);
+		mChances += blockChances;
+		mNumUnitsDone += end - begin;
 	}
 }
 
-constexpr uintmax_t CombinationNum(uint32_t n, uint32_t k)
+ChanceProgress ChanceJob::Poll() const
 {
-	return (k == 0) ? 1 : (n > k) ? n * CombinationNum(n - 1, k - 1) : 1;
+	ChanceProgress progress;
+	{
+		std::lock_guard<std::mutex> lk(mResultMutex);
+		progress.chances = mChances;
+		progress.numUnitsDone = mNumUnitsDone;
+	}
+	progress.numDeals = mNumDeals;
+	progress.numUnits = mNumUnits;
+	progress.finished = mGroup.Done();
+
+	if (progress.chances.total > 0)
+	{
+		const double scale = static_cast<double>(progress.numDeals) / progress.chances.total;
+		progress.estimate.total = static_cast<uintmax_t>(progress.chances.total * scale + 0.5);
+		progress.estimate.winning = static_cast<uintmax_t>(progress.chances.winning * scale + 0.5);
+		progress.estimate.split = static_cast<uintmax_t>(progress.chances.split * scale + 0.5);
+
+		const double elapsedMs = std::chrono::duration<double, std::milli>(Clock::now() - mStart).count();
+		progress.remainingMs = progress.finished ? 0 : elapsedMs * (scale - 1);
+	}
+	return progress;
 }
 
-constexpr uintmax_t Factorial(uint32_t n)
+ChanceProgress ChanceJob::Wait()
 {
-	return n <= 1 ? 1 : (n * Factorial(n - 1));
+	ThreadPool::Get().Wait(mGroup);
+	return Poll();
 }
 
-constexpr uintmax_t Combination(uint32_t n, uint32_t k)
+struct ChanceEstimate
 {
-	return (n - k < k) ? CombinationNum(n, n - k) / Factorial(n - k) : CombinationNum(n, k) / Factorial(k);
-}
+	ChanceEstimate() : equity(0), halfWidth(0) {}
 
-template <uint_fast8_t NumDeckCards> struct PermutationHelper;
-template <> struct PermutationHelper<7>
-{
-	static constexpr std::array<std::array<uint_fast8_t, 5>, Combination(7, 5)> value =
-	{
-		std::array<uint_fast8_t, 5>({ 2, 3, 4, 5, 6 }),
-		std::array<uint_fast8_t, 5>({ 1, 3, 4, 5, 6 }),
-		std::array<uint_fast8_t, 5>({ 1, 2, 4, 5, 6 }),
-		std::array<uint_fast8_t, 5>({ 1, 2, 3, 5, 6 }),
-		std::array<uint_fast8_t, 5>({ 1, 2, 3, 4, 6 }),
-		std::array<uint_fast8_t, 5>({ 1, 2, 3, 4, 5 }),
-		std::array<uint_fast8_t, 5>({ 0, 3, 4, 5, 6 }),
-		std::array<uint_fast8_t, 5>({ 0, 2, 4, 5, 6 }),
-		std::array<uint_fast8_t, 5>({ 0, 2, 3, 5, 6 }),
-		std::array<uint_fast8_t, 5>({ 0, 2, 3, 4, 6 }),
-		std::array<uint_fast8_t, 5>({ 0, 2, 3, 4, 5 }),
-		std::array<uint_fast8_t, 5>({ 0, 1, 4, 5, 6 }),
-		std::array<uint_fast8_t, 5>({ 0, 1, 3, 5, 6 }),
-		std::array<uint_fast8_t, 5>({ 0, 1, 3, 4, 6 }),
-		std::array<uint_fast8_t, 5>({ 0, 1, 3, 4, 5 }),
-		std::array<uint_fast8_t, 5>({ 0, 1, 2, 5, 6 }),
-		std::array<uint_fast8_t, 5>({ 0, 1, 2, 4, 6 }),
-		std::array<uint_fast8_t, 5>({ 0, 1, 2, 4, 5 }),
-		std::array<uint_fast8_t, 5>({ 0, 1, 2, 3, 6 }),
-		std::array<uint_fast8_t, 5>({ 0, 1, 2, 3, 5 }),
-		std::array<uint_fast8_t, 5>({ 0, 1, 2, 3, 4 })
-	};
+	Chances chances;
+	// (winning + split / 2) / total, with the half width of its confidence interval
+	double equity;
+	double halfWidth;
 };
 
-template <uint_fast8_t NumDeckCards>
-void GetBestHand(const std::array<Card, NumDeckCards>& cards, std::array<Card, 5>& bestHand)
+// Monte Carlo counterpart of GetChances: deals the missing cards at random in batches and stops as soon as the
+// confidence interval of the equity is within targetHalfWidth (zScore 1.96 for 95%), or after maxSamples deals.
+// Every round deals kBatchesPerRound batches in parallel, batch n from stream n of seed, so a seed gives the same
+// estimate whatever the number of pool threads. An empty estimate for the queries GetChances rejects.
+template <uint_fast8_t NumPlayerCards, uint_fast8_t NumOpponentCards, uint_fast8_t NumTableCards>
+ChanceEstimate SampleChances(const std::vector<Card>& playerCards, const std::vector<Card>& opponentCards, const std::vector<Card>& tableCards,
+	const std::vector<Card>& deadCards, double targetHalfWidth, uintmax_t maxSamples, double zScore = 1.96, uint64_t seed = 5489)
 {
-#if 1
-	constexpr auto numHandCards = std::tuple_size<std::decay_t<decltype(bestHand)>>::value;
-	constexpr auto numCards = NumDeckCards;
-	std::array<int_fast8_t, numCards> handPicker;
-	std::fill(handPicker.begin(), handPicker.end() - numHandCards, 0);
-	std::fill(handPicker.end() - numHandCards, handPicker.end(), 1);
-
-	for (int_fast16_t k = 0; k < numHandCards; ++k)
+	static_assert(NumPlayerCards + NumTableCards >= 5 && NumPlayerCards + NumTableCards <= 7
+		&& NumOpponentCards + NumTableCards >= 5 && NumOpponentCards + NumTableCards <= 7, "hands of 5 to 7 cards");
+
+	ChanceQuery query;
+	size_t shapeIndex;
+	if (!GetChanceQuery<NumPlayerCards, NumOpponentCards, NumTableCards>(playerCards, opponentCards, tableCards, deadCards, query, shapeIndex))
+		return ChanceEstimate();
+
+	static const uint_fast32_t kBatchSize = 1024;
+	static const uint_fast32_t kBatchesPerRound = 16;
+	// the variance of the first rounds is too rough to stop on
+	static const uintmax_t kMinSamples = 4 * uintmax_t(kBatchSize) * kBatchesPerRound;
+
+	const CardSet knownPlayerCards = query.playerCards;
+	const CardSet knownOpponentCards = query.opponentCards;
+	const CardSet knownTableCards = query.tableCards;
+	const CardSet knownCards = knownPlayerCards | knownOpponentCards | knownTableCards;
+
+	const uint_fast8_t missingPlayerCards = NumPlayerCards - static_cast<uint_fast8_t>(playerCards.size());
+	const uint_fast8_t missingOpponentCards = NumOpponentCards - static_cast<uint_fast8_t>(opponentCards.size());
+	const uint_fast8_t missingTableCards = NumTableCards - static_cast<uint_fast8_t>(tableCards.size());
+
+	// the batch slots live in the arena of the calling thread, so that repeated queries do not allocate; slot k
+	// deals batch k of every round
+	struct Slot
 	{
-		bestHand[k] = cards[k + numCards - numHandCards];
-	}
+		std::array<CardSet, kBatchSize> playerHands;
+		std::array<CardSet, kBatchSize> opponentHands;
+		std::array<HandRank, kBatchSize> playerRanks;
+		std::array<HandRank, kBatchSize> opponentRanks;
+		Chances chances;
+	};
 
-	std::decay_t<decltype(bestHand)> hand;
-	int_fast16_t hc;
-	while (std::next_permutation(handPicker.begin(), handPicker.end()))
-	{
-		hc = 0;
-		for (int_fast16_t k = 0; k < numCards; ++k)
+	auto& pool = ThreadPool::Get();
+	auto& arena = Arena::Local();
+	const Arena::Scope arenaScope(arena);
+	const uint64_t deckMask = (uint64_t(1) << CardDealer::kNumCards) - 1;
+	const CardDealer liveDealer(CardSet(deckMask & ~(knownCards | query.deadCards).mask));
+	Slot* const slots = arena.Allocate<Slot>(kBatchesPerRound);
+
+	// a batch depends on nothing but its index
+	auto dealBatch = [&](Slot& slot, uint64_t batchIndex, uint_fast32_t batchSize) {
+		Philox4x32 random(seed, batchIndex);
+		CardDealer dealer(liveDealer);
+		for (uint_fast32_t k = 0; k < batchSize; ++k)
+		{
+			dealer.Reset();
+			const CardSet player = knownPlayerCards | dealer.Deal(random, missingPlayerCards);
+			const CardSet opponent = knownOpponentCards | dealer.Deal(random, missingOpponentCards);
+			const CardSet table = knownTableCards | dealer.Deal(random, missingTableCards);
+			slot.playerHands[k] = player | table;
+			slot.opponentHands[k] = opponent | table;
+		}
+
+		if (NumPlayerCards + NumTableCards == 7 && NumOpponentCards + NumTableCards == 7)
+		{
+			GetHandRanks7(slot.playerHands.data(), slot.playerRanks.data(), batchSize);
+			GetHandRanks7(slot.opponentHands.data(), slot.opponentRanks.data(), batchSize);
+		}
+		else
 		{
-			if (handPicker[k] != 0)
+			for (uint_fast32_t k = 0; k < batchSize; ++k)
 			{
-				hand[hc++] = cards[k];
+				slot.playerRanks[k] = GetHandRank(slot.playerHands[k]);
+				slot.opponentRanks[k] = GetHandRank(slot.opponentHands[k]);
 			}
 		}
-		//printf("Hand type: %13s Hand: %s\n", ToString(GetHandType(&hand[0])).c_str(), ToString(&hand[0], 5).c_str());
-		ReplaceIfBetter(bestHand, hand);
-	}
-#else
-	constexpr auto numHandCards = std::tuple_size<std::decay_t<decltype(bestHand)>>::value;
-	constexpr auto combinations = std::tuple_size<decltype(PermutationHelper<NumDeckCards>::value)>::value;
 
-	bestHand[0] = cards[NumDeckCards - numHandCards];
-	bestHand[1] = cards[NumDeckCards - numHandCards + 1];
-	bestHand[2] = cards[NumDeckCards - numHandCards + 2];
-	bestHand[3] = cards[NumDeckCards - numHandCards + 3];
-	bestHand[4] = cards[NumDeckCards - numHandCards + 4];
+		slot.chances.total += batchSize;
+		for (uint_fast32_t k = 0; k < batchSize; ++k)
+		{
+			slot.chances.winning += (slot.playerRanks[k] > slot.opponentRanks[k]) ? 1 : 0;
+			slot.chances.split += (slot.playerRanks[k] == slot.opponentRanks[k]) ? 1 : 0;
+		}
+	};
 
-	std::decay_t<decltype(bestHand)> hand;
-	for (uint_fast32_t i = 0; i < combinations; ++i)
+	ChanceEstimate estimate;
+	auto& chances = estimate.chances;
+	for (uint64_t round = 0; chances.total < maxSamples; ++round)
 	{
-		hand[0] = cards[PermutationHelper<NumDeckCards>::value[i][0]];
-		hand[1] = cards[PermutationHelper<NumDeckCards>::value[i][1]];
-		hand[2] = cards[PermutationHelper<NumDeckCards>::value[i][2]];
-		hand[3] = cards[PermutationHelper<NumDeckCards>::value[i][3]];
-		hand[4] = cards[PermutationHelper<NumDeckCards>::value[i][4]];
-		ReplaceIfBetter(bestHand, hand);
+		// the batches of a round are shortened evenly so that they stay within maxSamples
+		const auto roundSize = MIN(uintmax_t(kBatchSize) * kBatchesPerRound, maxSamples - chances.total);
+		pool.ParallelFor(kBatchesPerRound, 1, [&](uint64_t k, uint64_t) {
+			const auto batchSize = static_cast<uint_fast32_t>(roundSize / kBatchesPerRound + ((k < roundSize % kBatchesPerRound) ? 1 : 0));
+			dealBatch(slots[k], round * kBatchesPerRound + k, batchSize);
+		});
+
+		chances = Chances();
+		for (uint_fast32_t k = 0; k < kBatchesPerRound; ++k)
+			chances += slots[k].chances;
+
+		// each deal scores 1, 1/2 or 0
+		const double n = static_cast<double>(chances.total);
+		const double sum = chances.winning + 0.5 * chances.split;
+		const double sumSquares = chances.winning + 0.25 * chances.split;
+		estimate.equity = sum / n;
+		const double variance = (n > 1) ? MAX(0.0, (sumSquares - sum * estimate.equity) / (n - 1)) : 0;
+		estimate.halfWidth = zScore * sqrt(variance / n);
+
+		if (chances.total >= kMinSamples && estimate.halfWidth <= targetHalfWidth)
+			break;
 	}
-#endif
+
+	return estimate;
 }
 
-struct Chances
+struct MultiwayChances
 {
-	Chances() : total(0), winning(0), split(0) {}
-	Chances& operator+=(const Chances& c) { total += c.total; winning += c.winning; split += c.split; return *this; }
-	const Chances operator+(const Chances& c) const { return Chances(*this) += c; }
+	// a pot splits evenly between any number of tied seats up to 10
+	static const uint_fast32_t kPotShares = 2520;
+
+	explicit MultiwayChances(size_t numSeats = 0) : total(0), winning(numSeats, 0), shares(numSeats, 0), exact(true) {}
+
+	// the counts of other deals of as many seats
+	MultiwayChances& operator+=(const MultiwayChances& c)
+	{
+		total += c.total;
+		for (size_t seat = 0; seat < shares.size(); ++seat)
+		{
+			winning[seat] += c.winning[seat];
+			shares[seat] += c.shares[seat];
+		}
+		return *this;
+	}
+
+	double Equity(size_t seat) const { return (total > 0) ? shares[seat] / (double(total) * kPotShares) : 0; }
 
 	uintmax_t total;
-	uintmax_t winning;
-	uintmax_t split;
+	// deals won alone, per seat
+	std::vector<uintmax_t> winning;
+	// pots won in kPotShares parts, per seat
+	std::vector<uintmax_t> shares;
+	bool exact;
 };
 
-static const int32_t numThreads = 8;
-static const int32_t handsPerThread = 2500;
-
-template <typename T>
-void FastCopy(
-	decltype(declval<std:vector<T>>().cbegin())& srcBegin, 
-	decltype(declval<std:vector<T>>().cend())& srcEnd, 
-	decltype(declval<std:vector<T>>().begin())& dst)
+// Showdowns of several seats on shared tables; the table state is built once and each seat adds its hole cards to it
+class MultiwayShowdown
 {
-	static auto copy = [](auto v, const T* src, T* dst) {
-		typedef decltype(v) copy_t;
-		reinterpret_cast<copy_t&>(*dst) = reinterpret_cast<const copy_t&>(*src);
-	};
+public:
+	static const size_t kMaxSeats = 10;
 
-	uint_fast32_t totalSize = (srcEnd - srcBegin) * sizeof(T);
-	while (totalSize > 8)
-	switch (totalSize)
+	MultiwayShowdown(MultiwayChances& chances, size_t numSeats) : mChances(chances), mNumSeats(numSeats)
 	{
-	case 1:
-		copy(int8_t(), srcBegin, dst);
-		break;
-	case 2:
-		copy(int16_t(), srcBegin, dst);
-		break;
-	case 3:
-		copy(int16_t(), srcBegin, dst);
-		copy(int8_t(), srcBegin + 2, dst + 2);
-		break;
-	case 4:
-		copy(int32_t(), srcBegin, dst);
-		break;
-	case 5:
-		copy(int32_t(), srcBegin, dst);
-		copy(int8_t(), srcBegin + 4, dst + 4);
-		break;
-	case 6:
-		copy(int32_t(), srcBegin, dst);
-		copy(int16_t(), srcBegin + 4, dst + 4);
-		break;
-	case 7:
-		copy(int32_t(), srcBegin, dst);
-		copy(int16_t(), srcBegin + 4, dst + 4);
-		copy(int8_t(), srcBegin + 6, dst + 6);
-		break;
-	case 8:
-		copy(int64_t(), srcBegin, dst);
-		break;
+		assert(numSeats >= 2 && numSeats <= kMaxSeats);
+	}
+
+	void Add(const CardSet* seatCards, CardSet tableCards)
+	{
+		const HandState tableState(tableCards);
+		std::array<HandRank, kMaxSeats> ranks;
+		HandRank bestRank = 0;
+		uint_fast32_t numWinners = 0;
+		for (size_t seat = 0; seat < mNumSeats; ++seat)
+		{
+			auto state = tableState;
+			for (auto cards = seatCards[seat].mask; cards != 0; cards &= cards - 1)
+				state = state.AddBit(LowestBit(cards));
+			ranks[seat] = state.Rank();
+
+			if (seat == 0 || ranks[seat] > bestRank)
+			{
+				bestRank = ranks[seat];
+				numWinners = 1;
+			}
+			else if (ranks[seat] == bestRank)
+			{
+				++numWinners;
+			}
+		}
+
+		++mChances.total;
+		const auto share = MultiwayChances::kPotShares / numWinners;
+		for (size_t seat = 0; seat < mNumSeats; ++seat)
+		{
+			if (ranks[seat] == bestRank)
+			{
+				mChances.shares[seat] += share;
+				mChances.winning[seat] += (numWinners == 1) ? 1 : 0;
+			}
+		}
+	}
+
+private:
+	MultiwayChances& mChances;
+	size_t mNumSeats;
+};
+
+// calls visitor with every subset of mask having the given size
+template <typename Visitor>
+void ForEachSubset(uint64_t mask, uint_fast8_t size, Visitor& visitor, uint64_t picked = 0)
+{
+	if (size == 0)
+	{
+		visitor(picked);
+		return;
+	}
+	for (auto rest = mask; PopCount(rest) >= size;)
+	{
+		const auto bit = rest & (0 - rest);
+		rest ^= bit;
+		ForEachSubset(rest, size - 1, visitor, picked | bit);
 	}
 }
 
-template <uint_fast8_t NumPlayerCards, uint_fast8_t NumOpponentCards, uint_fast8_t NumTableCards>
-static Chances ProcessTest(const std::array<Card, NumPlayerCards>& playerCards, const std::array<Card, NumOpponentCards>& opponentCards, const std::array<Card, NumTableCards>& tableCards)
+// Deals the missing hole cards seat by seat, then every table
+class MultiwayEnumerator
 {
-	thread_local std::array<Card, 5> bestPlayerHand;
-	thread_local std::array<Card, 5> bestOpponentHand;
+public:
+	MultiwayEnumerator(MultiwayShowdown& showdown, std::vector<CardSet>& seatCards, const std::vector<uint_fast8_t>& missingSeatCards,
+		CardSet tableCards, uint_fast8_t missingTableCards)
+		: mShowdown(showdown)
+		, mSeatCards(seatCards)
+		, mMissingSeatCards(missingSeatCards)
+		, mTableCards(tableCards)
+		, mMissingTableCards(missingTableCards)
+	{}
+
+	void Deal(size_t seat, uint64_t liveCards)
+	{
+		if (seat == mSeatCards.size())
+		{
+			auto addTable = [this](uint64_t tableCards) { mShowdown.Add(mSeatCards.data(), CardSet(mTableCards.mask | tableCards)); };
+			ForEachSubset(liveCards, mMissingTableCards, addTable);
+			return;
+		}
 
-	thread_local std::array<Card, NumPlayerCards + NumTableCards> playerDeck;
-	thread_local std::array<Card, NumOpponentCards + NumTableCards> opponentDeck;
+		const auto knownCards = mSeatCards[seat];
+		auto dealSeat = [&](uint64_t holeCards) {
+			mSeatCards[seat].mask = knownCards.mask | holeCards;
+			Deal(seat + 1, liveCards & ~holeCards);
+		};
+		ForEachSubset(liveCards, mMissingSeatCards[seat], dealSeat);
+		mSeatCards[seat] = knownCards;
+	}
+
+private:
+	MultiwayShowdown& mShowdown;
+	std::vector<CardSet>& mSeatCards;
+	const std::vector<uint_fast8_t>& mMissingSeatCards;
+	CardSet mTableCards;
+	uint_fast8_t mMissingTableCards;
+};
 
-	std::copy(playerCards.cbegin(), playerCards.cend(), playerDeck.begin());
-	std::copy(tableCards.cbegin(), tableCards.cend(), playerDeck.begin() + NumPlayerCards);
-	std::sort(playerDeck.begin(), playerDeck.end());
-	GetBestHand(playerDeck, bestPlayerHand);
+// Hold'em chances of every seat, 2 to 10 of them, each knowing up to 2 hole cards. All deals are enumerated when
+// there are at most maxExactDeals of them, otherwise numSamples deals are drawn at random. No seats for other
+// numbers of seats or cards, cards given twice or a deck too short.
+MultiwayChances GetMultiwayChances(const std::vector<std::vector<Card>>& seatCards, const std::vector<Card>& tableCards,
+	uintmax_t maxExactDeals = 50000000, uintmax_t numSamples = 10000000, uint64_t seed = 5489)
+{
+	static const uint_fast8_t kNumHoleCards = 2;
+	static const uint_fast8_t kNumTableCards = 5;
+
+	const size_t numSeats = seatCards.size();
+	if (numSeats < 2 || numSeats > MultiwayShowdown::kMaxSeats || tableCards.size() > kNumTableCards)
+		return MultiwayChances();
+
+	std::vector<CardSet> knownSeatCards(numSeats);
+	std::vector<uint_fast8_t> missingSeatCards(numSeats);
+	CardSet knownCards(tableCards.data(), tableCards.size());
+	size_t numGivenCards = tableCards.size();
+	for (size_t seat = 0; seat < numSeats; ++seat)
+	{
+		if (seatCards[seat].size() > kNumHoleCards)
+			return MultiwayChances();
+		knownSeatCards[seat] = CardSet(seatCards[seat].data(), seatCards[seat].size());
+		missingSeatCards[seat] = kNumHoleCards - static_cast<uint_fast8_t>(seatCards[seat].size());
+		knownCards |= knownSeatCards[seat];
+		numGivenCards += seatCards[seat].size();
+	}
+	const CardSet knownTableCards(tableCards.data(), tableCards.size());
+	const uint_fast8_t missingTableCards = kNumTableCards - static_cast<uint_fast8_t>(tableCards.size());
+
+	const uint64_t deckMask = (uint64_t(1) << (CardSet::kColorShift * static_cast<uint_fast8_t>(CardColor::Count))) - 1;
+	const uint64_t liveMask = deckMask & ~knownCards.mask;
+	const size_t numMissingCards = numSeats * kNumHoleCards + kNumTableCards - numGivenCards;
+	if (knownCards.Size() != numGivenCards || (knownCards.mask & ~deckMask) != 0 || numMissingCards > PopCount(liveMask))
+		return MultiwayChances();
+
+	MultiwayChances chances(numSeats);
+	std::mutex mutex;
+
+	// counted in floating point, a full ring with unknown hands overflows any integer
+	double numDeals = 1;
+	uint32_t numLiveCards = PopCount(liveMask);
+	for (size_t seat = 0; seat < numSeats; ++seat)
+	{
+		numDeals *= static_cast<double>(Combination(numLiveCards, missingSeatCards[seat]));
+		numLiveCards -= missingSeatCards[seat];
+	}
+	numDeals *= static_cast<double>(Combination(numLiveCards, missingTableCards));
 
-	std::copy(opponentCards.cbegin(), opponentCards.cend(), opponentDeck.begin());
-	std::copy(tableCards.cbegin(), tableCards.cend(), opponentDeck.begin() + NumOpponentCards);
-	std::sort(opponentDeck.begin(), opponentDeck.end());
-	GetBestHand(opponentDeck, bestOpponentHand);
+	if (numDeals <= static_cast<double>(maxExactDeals))
+	{
+		// split over the pool by the hole cards of the first seat missing any, by the table when none is
+		size_t firstSeat = 0;
+		while (firstSeat < numSeats && missingSeatCards[firstSeat] == 0)
+			++firstSeat;
+		const uint_fast8_t firstCards = (firstSeat < numSeats) ? missingSeatCards[firstSeat] : missingTableCards;
+		ParallelForEachSubset(liveMask, firstCards, [&](uint64_t begin, uint64_t end) {
+			MultiwayChances rangeChances(numSeats);
+			MultiwayShowdown rangeShowdown(rangeChances, numSeats);
+			std::vector<CardSet> rangeSeatCards(knownSeatCards);
+			MultiwayEnumerator enumerator(rangeShowdown, rangeSeatCards, missingSeatCards, knownTableCards, missingTableCards);
+			auto dealFirst = [&](uint64_t cards) {
+				if (firstSeat == numSeats)
+				{
+					rangeShowdown.Add(rangeSeatCards.data(), CardSet(knownTableCards.mask | cards));
+					return;
+				}
+				rangeSeatCards[firstSeat].mask = knownSeatCards[firstSeat].mask | cards;
+				enumerator.Deal(firstSeat + 1, liveMask & ~cards);
+			};
+			ForEachSubsetInRange(liveMask, firstCards, begin, end, dealFirst);
+
+			std::lock_guard<std::mutex> lk(mutex);
+			chances += rangeChances;
+		});
+		return chances;
+	}
 
-	const auto comparisonResult = CompareHands(&bestPlayerHand[0], &bestOpponentHand[0]);
+	chances.exact = false;
+	// block n of the samples is dealt from stream n of seed, so the blocks may run on any threads in any order
+	static const uintmax_t kSamplesPerBlock = 1 << 16;
+	const CardDealer liveDealer((CardSet(liveMask)));
+	ThreadPool::Get().ParallelFor((numSamples + kSamplesPerBlock - 1) / kSamplesPerBlock, 1, [&](uint64_t block, uint64_t) {
+		MultiwayChances blockChances(numSeats);
+		MultiwayShowdown blockShowdown(blockChances, numSeats);
+		std::array<CardSet, MultiwayShowdown::kMaxSeats> dealtSeatCards;
+		Philox4x32 random(seed, block);
+		CardDealer dealer(liveDealer);
+		const auto blockSamples = MIN(kSamplesPerBlock, numSamples - block * kSamplesPerBlock);
+		for (uintmax_t sample = 0; sample < blockSamples; ++sample)
+		{
+			// dealt to the seats in turn and the rest to the table
+			dealer.Reset();
+			for (size_t seat = 0; seat < numSeats; ++seat)
+				dealtSeatCards[seat] = knownSeatCards[seat] | dealer.Deal(random, missingSeatCards[seat]);
+			blockShowdown.Add(dealtSeatCards.data(), knownTableCards | dealer.Deal(random, missingTableCards));
+		}
 
-	thread_local Chances chances;
-	chances.total = 1;
-	chances.winning = (comparisonResult == 1) ? 1 : 0;
-	chances.split = (comparisonResult == 0) ? 1 : 0;
+		std::lock_guard<std::mutex> lk(mutex);
+		chances += blockChances;
+	});
 
 	return chances;
 }
 
-template <uint_fast8_t NumPlayerCards, uint_fast8_t NumOpponentCards, uint_fast8_t NumTableCards>
-class ChanceCollector
+// Exact heads up preflop chances of all hole cards against all hole cards. Matchups equal up to a suit permutation
+// and a swap of the two hands share a class and are computed once; the file holds the class of every matchup with
+// a bit telling whether it is seen from the other hand, the results of every class and the results summed over the
+// 169 groups of hole cards (pairs, suited and offsuit). It is mapped, not read.
+class PreflopDatabase
 {
 public:
-	explicit ChanceCollector(uint_fast32_t numThreads, uint_fast32_t threadBlockSize);
-	virtual ~ChanceCollector();
+	static const uint_fast32_t kNumHoleCards = 1326;
+	static const uint_fast32_t kNumGroups = 169;
+
+	PreflopDatabase();
+	~PreflopDatabase();
+
+	// 0 to 1325, by the colex order of the two card bits
+	static uint_fast16_t HoleCardsIndex(CardSet holeCards);
+	// row major in a 13x13 grid: pairs on the diagonal, suited above it and offsuit below
+	static uint_fast8_t HoleCardsGroup(CardSet holeCards);
 
-	void Initialize();
-	void JoinAll();
-	Chances GetResult() const;
+	static bool Generate(const char* fileName);
 
-	void AddTest(const std::array<Card, NumPlayerCards>& playerCards, const std::array<Card, NumOpponentCards>& opponentCards, const std::array<Card, NumTableCards>& tableCards);
+	bool Open(const char* fileName);
+	void Close();
+	bool IsOpen() const { return mView != nullptr; }
+
+	// all the tables for two known hole cards each; nothing when they share a card
+	Chances Lookup(CardSet playerCards, CardSet opponentCards) const;
+	// summed over all the non overlapping hole cards of both groups
+	Chances LookupGroups(uint_fast8_t playerGroup, uint_fast8_t opponentGroup) const;
 
 private:
-	struct Test
+	static const uint32_t kMagic = 0x51454650; // "PFEQ"
+	static const uint32_t kVersion = 1;
+	static const uint16_t kNoClass = 0xFFFF;
+
+	struct Header
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint32_t numClasses;
+		uint32_t reserved;
+	};
+	struct ClassResult
 	{
-		std::array<Card, NumPlayerCards> playerCards;
-		std::array<Card, NumOpponentCards> opponentCards;
-		std::array<Card, NumTableCards> tableCards;
+		uint32_t total;
+		uint32_t winning;
+		uint32_t split;
+	};
+	struct GroupResult
+	{
+		uint64_t total;
+		uint64_t winning;
+		uint64_t split;
 	};
 
-	struct Signal
+	static const size_t kNumMatchups = kNumHoleCards * kNumHoleCards;
+
+	// header, class of each matchup, group results, class results, swapped matchup bits
+	static size_t FileSize(uint32_t numClasses)
 	{
-		bool condition;
-		std::mutex mutex;
-		std::condition_variable conditionVariable;
+		return sizeof(Header) + kNumMatchups * sizeof(uint16_t) + kNumGroups * kNumGroups * sizeof(GroupResult)
+			+ numClasses * sizeof(ClassResult) + (kNumMatchups + 7) / 8;
+	}
 
-		Signal() : condition(false) {}
-		void Wait()
-		{
-			std::unique_lock<decltype(mutex)> lk(mutex);
-			while (!condition)
-				conditionVariable.wait(lk, [this]() { return condition; });
-		}
-		void Clear()
-		{
-			std::unique_lock<decltype(mutex)> lk(mutex);
-			condition = false;
-		}
-		void Raise()
-		{
-			std::unique_lock<decltype(mutex)> lk(mutex);
-			condition = true;
-			lk.unlock();
-			conditionVariable.notify_all();
-		}
-		bool Check()
+	HANDLE mFile;
+	HANDLE mMapping;
+	const void* mView;
+	const uint16_t* mClassIds;
+	const GroupResult* mGroupResults;
+	const ClassResult* mClassResults;
+	const uint8_t* mSwapped;
+};
+
+PreflopDatabase::PreflopDatabase()
+	: mFile(INVALID_HANDLE_VALUE)
+	, mMapping(nullptr)
+	, mView(nullptr)
+	, mClassIds(nullptr)
+	, mGroupResults(nullptr)
+	, mClassResults(nullptr)
+	, mSwapped(nullptr)
+{}
+
+PreflopDatabase::~PreflopDatabase()
+{
+	Close();
+}
+
+uint_fast16_t PreflopDatabase::HoleCardsIndex(CardSet holeCards)
+{
+	assert(holeCards.Size() == 2);
+	const auto low = LowestBit(holeCards.mask);
+	const auto high = LowestBit(holeCards.mask & (holeCards.mask - 1));
+	return high * (high - 1) / 2 + low;
+}
+
+uint_fast8_t PreflopDatabase::HoleCardsGroup(CardSet holeCards)
+{
+	assert(holeCards.Size() == 2);
+	const auto low = LowestBit(holeCards.mask);
+	const auto high = LowestBit(holeCards.mask & (holeCards.mask - 1));
+	const auto lowValue = low % CardSet::kColorShift;
+	const auto highValue = high % CardSet::kColorShift;
+	const auto minValue = MIN(lowValue, highValue);
+	const auto maxValue = MAX(lowValue, highValue);
+	const bool suited = low / CardSet::kColorShift == high / CardSet::kColorShift;
+	return suited ? minValue * CardSet::kColorShift + maxValue : maxValue * CardSet::kColorShift + minValue;
+}
+
+bool PreflopDatabase::Generate(const char* fileName)
+{
+	std::array<CardSet, kNumHoleCards> holeCards;
+	for (uint_fast8_t high = 1; high < 52; ++high)
+	{
+		for (uint_fast8_t low = 0; low < high; ++low)
 		{
-			std::unique_lock<decltype(mutex)> lk(mutex);
-			return condition;
+			const CardSet cards((uint64_t(1) << high) | (uint64_t(1) << low));
+			holeCards[HoleCardsIndex(cards)] = cards;
 		}
-	};
+	}
 
-	struct Semaphore
+	// a class stands for the matchup with the smallest masks among its suit permutations, either way round
+	const SuitSymmetry symmetry;
+	std::vector<uint16_t> classIds(kNumMatchups, kNoClass);
+	std::vector<uint8_t> swapped((kNumMatchups + 7) / 8, 0);
+	std::map<std::pair<uint64_t, uint64_t>, uint16_t> classIdsByMatchup;
+	std::vector<std::pair<CardSet, CardSet>> classMatchups;
+	for (uint_fast32_t player = 0; player < kNumHoleCards; ++player)
 	{
-		uint_fast32_t value;
-		std::mutex mutex;
-		std::condition_variable conditionVariable;
-
-		Semaphore(uint_fast32_t v = 0) : value(v) {}
-		void Set(uint_fast32_t v)
+		for (uint_fast32_t opponent = 0; opponent < kNumHoleCards; ++opponent)
 		{
-			std::unique_lock<decltype(mutex)> lk(mutex);
-			value = v;
-			if (value > 0)
+			if (holeCards[player].Intersects(holeCards[opponent]))
+				continue;
+
+			auto matchup = std::make_pair(holeCards[player].mask, holeCards[opponent].mask);
+			auto swappedMatchup = std::make_pair(holeCards[opponent].mask, holeCards[player].mask);
+			for (const auto& permutation : symmetry)
 			{
-				lk.unlock();
-				conditionVariable.notify_all();
+				const auto playerMask = SuitSymmetry::Apply(holeCards[player], permutation).mask;
+				const auto opponentMask = SuitSymmetry::Apply(holeCards[opponent], permutation).mask;
+				matchup = std::min(matchup, std::make_pair(playerMask, opponentMask));
+				swappedMatchup = std::min(swappedMatchup, std::make_pair(opponentMask, playerMask));
 			}
-		}
-		void Wait()
-		{
-			std::unique_lock<decltype(mutex)> lk(mutex);
-			while (value == 0)
-				conditionVariable.wait(lk, [this]() { return value > 0; });
-		}
-		void Inc()
-		{
-			std::unique_lock<decltype(mutex)> lk(mutex);
-			++value;
-			lk.unlock();
-			conditionVariable.notify_all();
-		}
-		void Dec()
-		{
-			std::unique_lock<decltype(mutex)> lk(mutex);
-			if (value > 0)
+
+			const auto matchupIndex = player * kNumHoleCards + opponent;
+			if (swappedMatchup < matchup)
+			{
+				matchup = swappedMatchup;
+				swapped[matchupIndex / 8] |= 1 << (matchupIndex % 8);
+			}
+			const auto inserted = classIdsByMatchup.insert(std::make_pair(matchup, static_cast<uint16_t>(classMatchups.size())));
+			if (inserted.second)
 			{
-				--value;
+				classMatchups.push_back(std::make_pair(CardSet(matchup.first), CardSet(matchup.second)));
 			}
+			classIds[matchupIndex] = inserted.first->second;
 		}
-	};
+	}
+	assert(classMatchups.size() < kNoClass);
 
-	struct ThreadData
-	{
-		Chances result;
-		std::vector<Test> block;
-		int_fast32_t blockFillCount;
-		std::mutex resultMutex;
-		std::thread thread;
-		Signal readyToProcess;
+	static auto toCards = [](CardSet cards) {
+		std::vector<Card> result;
+		for (auto mask = cards.mask; mask != 0; mask &= mask - 1)
+			result.push_back(CardSet::BitCard(LowestBit(mask)));
+		return result;
 	};
 
-	void WorkerThread(ThreadData& threadData, uint_fast32_t threadBlockSize)
+	// the classes are pool tasks, each GetChances splitting its own enumeration further
+	std::vector<ClassResult> classResults(classMatchups.size());
+	ThreadPool::Get().ParallelFor(classMatchups.size(), 1, [&](uint64_t begin, uint64_t end) {
+		for (auto classId = begin; classId < end; ++classId)
+		{
+			const auto chances = GetChances<2, 2, 5>(toCards(classMatchups[classId].first), toCards(classMatchups[classId].second), {});
+			classResults[classId].total = static_cast<uint32_t>(chances.total);
+			classResults[classId].winning = static_cast<uint32_t>(chances.winning);
+			classResults[classId].split = static_cast<uint32_t>(chances.split);
+		}
+	});
+
+	std::vector<GroupResult> groupResults(kNumGroups * kNumGroups, GroupResult());
+	for (uint_fast32_t player = 0; player < kNumHoleCards; ++player)
 	{
-		bool notFinished = true;
-		while (notFinished)
+		for (uint_fast32_t opponent = 0; opponent < kNumHoleCards; ++opponent)
 		{
-			threadData.readyToProcess.Wait();
+			const auto matchupIndex = player * kNumHoleCards + opponent;
+			const auto classId = classIds[matchupIndex];
+			if (classId == kNoClass)
+				continue;
 
-			Chances results;
-			for (const auto& test : threadData.block)
-			{
-				results += ProcessTest(test.playerCards, test.opponentCards, test.tableCards);
-			}
+			const auto& classResult = classResults[classId];
+			const bool isSwapped = (swapped[matchupIndex / 8] >> (matchupIndex % 8) & 1) != 0;
+			auto& groupResult = groupResults[HoleCardsGroup(holeCards[player]) * kNumGroups + HoleCardsGroup(holeCards[opponent])];
+			groupResult.total += classResult.total;
+			groupResult.winning += isSwapped ? classResult.total - classResult.winning - classResult.split : classResult.winning;
+			groupResult.split += classResult.split;
+		}
+	}
+
+	FILE* file = nullptr;
+	if (fopen_s(&file, fileName, "wb") != 0 || file == nullptr)
+		return false;
+
+	Header header = {kMagic, kVersion, static_cast<uint32_t>(classResults.size()), 0};
+	bool written = fwrite(&header, sizeof(header), 1, file) == 1
+		&& fwrite(classIds.data(), sizeof(uint16_t), classIds.size(), file) == classIds.size()
+		&& fwrite(groupResults.data(), sizeof(GroupResult), groupResults.size(), file) == groupResults.size()
+		&& fwrite(classResults.data(), sizeof(ClassResult), classResults.size(), file) == classResults.size()
+		&& fwrite(swapped.data(), sizeof(uint8_t), swapped.size(), file) == swapped.size();
+	written = (fclose(file) == 0) && written;
+	return written;
+}
 
-			notFinished = threadData.block.size() == threadBlockSize;
+bool PreflopDatabase::Open(const char* fileName)
+{
+	Close();
 
-			threadData.blockFillCount = 0;
-			threadData.readyToProcess.Clear();
-			mReadyToFill.Inc();
+	mFile = CreateFileA(fileName, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (mFile == INVALID_HANDLE_VALUE)
+		return false;
 
-			std::lock_guard<decltype(threadData.resultMutex)> lk(threadData.resultMutex);
-			threadData.result += results;
-		}
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(mFile, &fileSize) || fileSize.QuadPart < static_cast<int64_t>(FileSize(0)))
+	{
+		Close();
+		return false;
 	}
 
-	std::deque<ThreadData> mThreadData;
-	Semaphore mReadyToFill;
-	uint_fast32_t mNumThreads;
-	uint_fast32_t mThreadBlockSize;
-};
+	mMapping = CreateFileMappingA(mFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	mView = (mMapping != nullptr) ? MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+	if (mView == nullptr)
+	{
+		Close();
+		return false;
+	}
 
-template <uint_fast8_t NumPlayerCards, uint_fast8_t NumOpponentCards, uint_fast8_t NumTableCards>
-ChanceCollector<NumPlayerCards, NumOpponentCards, NumTableCards>::ChanceCollector(uint_fast32_t numThreads, uint_fast32_t threadBlockSize)
-	: mNumThreads(numThreads)
-	, mThreadBlockSize(threadBlockSize)
-{}
+	const auto& header = *static_cast<const Header*>(mView);
+	if (header.magic != kMagic || header.version != kVersion || fileSize.QuadPart != static_cast<int64_t>(FileSize(header.numClasses)))
+	{
+		Close();
+		return false;
+	}
 
-template <uint_fast8_t NumPlayerCards, uint_fast8_t NumOpponentCards, uint_fast8_t NumTableCards>
-ChanceCollector<NumPlayerCards, NumOpponentCards, NumTableCards>::~ChanceCollector()
-{}
+	mClassIds = reinterpret_cast<const uint16_t*>(static_cast<const uint8_t*>(mView) + sizeof(Header));
+	mGroupResults = reinterpret_cast<const GroupResult*>(mClassIds + kNumMatchups);
+	mClassResults = reinterpret_cast<const ClassResult*>(mGroupResults + kNumGroups * kNumGroups);
+	mSwapped = reinterpret_cast<const uint8_t*>(mClassResults + header.numClasses);
+	return true;
+}
 
-template <uint_fast8_t NumPlayerCards, uint_fast8_t NumOpponentCards, uint_fast8_t NumTableCards>
-void ChanceCollector<NumPlayerCards, NumOpponentCards, NumTableCards>::Initialize()
+void PreflopDatabase::Close()
 {
-	mThreadData.resize(mNumThreads);
-	for (auto& threadData : mThreadData)
-	{
-		threadData.block.resize(mThreadBlockSize);
-		threadData.blockFillCount = 0;
-	}
+	if (mView != nullptr)
+		UnmapViewOfFile(mView);
+	if (mMapping != nullptr)
+		CloseHandle(mMapping);
+	if (mFile != INVALID_HANDLE_VALUE)
+		CloseHandle(mFile);
+
+	mFile = INVALID_HANDLE_VALUE;
+	mMapping = nullptr;
+	mView = nullptr;
+	mClassIds = nullptr;
+	mGroupResults = nullptr;
+	mClassResults = nullptr;
+	mSwapped = nullptr;
+}
 
-	mReadyToFill.Set(mNumThreads);
+Chances PreflopDatabase::Lookup(CardSet playerCards, CardSet opponentCards) const
+{
+	assert(IsOpen());
 
-	for (auto& threadData : mThreadData)
+	Chances chances;
+	const auto matchupIndex = HoleCardsIndex(playerCards) * kNumHoleCards + HoleCardsIndex(opponentCards);
+	const auto classId = mClassIds[matchupIndex];
+	if (classId != kNoClass)
 	{
-		threadData.thread = std::thread(&ChanceCollector::WorkerThread, this, std::ref(threadData), mThreadBlockSize);
+		const auto& classResult = mClassResults[classId];
+		const bool isSwapped = (mSwapped[matchupIndex / 8] >> (matchupIndex % 8) & 1) != 0;
+		chances.total = classResult.total;
+		chances.winning = isSwapped ? classResult.total - classResult.winning - classResult.split : classResult.winning;
+		chances.split = classResult.split;
 	}
+	return chances;
 }
 
-template <uint_fast8_t NumPlayerCards, uint_fast8_t NumOpponentCards, uint_fast8_t NumTableCards>
-void ChanceCollector<NumPlayerCards, NumOpponentCards, NumTableCards>::AddTest(
-	const std::array<Card, NumPlayerCards>& playerCards, const std::array<Card, NumOpponentCards>& opponentCards, const std::array<Card, NumTableCards>& tableCards)
+Chances PreflopDatabase::LookupGroups(uint_fast8_t playerGroup, uint_fast8_t opponentGroup) const
+{
+	assert(IsOpen());
+	assert(playerGroup < kNumGroups && opponentGroup < kNumGroups);
+
+	const auto& groupResult = mGroupResults[playerGroup * kNumGroups + opponentGroup];
+	Chances chances;
+	chances.total = groupResult.total;
+	chances.winning = groupResult.winning;
+	chances.split = groupResult.split;
+	return chances;
+}
+
+// A weighted two-card combo of a hand range
+struct RangeCombo
+{
+	RangeCombo() : weight(0) {}
+	RangeCombo(CardSet c, double w) : cards(c), weight(w) {}
+
+	CardSet cards;
+	double weight;
+};
+
+typedef std::vector<RangeCombo> HandRange;
+
+// sums over all live combo pairs and tables of the product of both combo weights
+struct RangeChances
 {
-	mReadyToFill.Wait();
-	decltype(mThreadData.begin()) maxIt;
-	decltype(maxIt->blockFillCount) maxBlock = -1;
-	for (auto it = mThreadData.begin(); it != mThreadData.end(); ++it)
+	RangeChances() : total(0), winning(0), split(0) {}
+	RangeChances& operator+=(const RangeChances& c) { total += c.total; winning += c.winning; split += c.split; return *this; }
+
+	double Equity() const { return (total > 0) ? (winning + split / 2) / total : 0; }
+
+	double total;
+	double winning;
+	double split;
+};
+
+// Range against range on one table at a time. Both ranges' live combos are ranked once and sorted; walking the
+// player combos up the ranks, the opponent weights below and up to the current rank are summed as a whole and
+// per card, so the combos sharing a card with the player combo are taken out without pairing any two combos.
+class RangeShowdown
+{
+public:
+	static const uint_fast8_t kNumCards = CardSet::kColorShift * static_cast<uint_fast8_t>(CardColor::Count);
+
+	RangeShowdown(const HandRange& playerRange, const HandRange& opponentRange)
+		: mPlayerRange(playerRange)
+		, mOpponentRange(opponentRange)
+		, mOpponentWeights(PreflopDatabase::kNumHoleCards, 0)
 	{
-		if (!it->readyToProcess.Check())
+		for (const auto& combo : opponentRange)
 		{
-			if (it->blockFillCount > maxBlock)
-			{
-				maxBlock = it->blockFillCount;
-				maxIt = it;
-			}
+			assert(combo.cards.Size() == 2);
+			mOpponentWeights[PreflopDatabase::HoleCardsIndex(combo.cards)] += combo.weight;
 		}
+		mPlayerRanks.reserve(playerRange.size());
+		mOpponentRanks.reserve(opponentRange.size());
 	}
-	assert(maxBlock >= 0);
-	assert((int32_t)maxBlock < (int32_t)mThreadBlockSize);
-	auto& test = maxIt->block[maxBlock];
-	assert(playerCards.size() == test.playerCards.size());
-	assert(opponentCards.size() == test.opponentCards.size());
-	assert(tableCards.size() == test.tableCards.size());
-	std::copy(playerCards.begin(), playerCards.end(), test.playerCards.begin());
-	std::copy(opponentCards.begin(), opponentCards.end(), test.opponentCards.begin());
-	std::copy(tableCards.begin(), tableCards.end(), test.tableCards.begin());
 
-	maxIt->blockFillCount++;
-	if (maxIt->blockFillCount == maxIt->block.size())
+	// adds tableCards, standing for tableWeight tables
+	void Add(CardSet tableCards, double tableWeight = 1)
 	{
-		mReadyToFill.Dec();
-		maxIt->readyToProcess.Raise();
+		const HandState tableState(tableCards);
+		RankLive(mPlayerRange, tableState, mPlayerRanks);
+		RankLive(mOpponentRange, tableState, mOpponentRanks);
+
+		double all = 0;
+		std::array<double, kNumCards> cardAll = {};
+		for (const auto& ranked : mOpponentRanks)
+		{
+			const auto& combo = mOpponentRange[ranked.second];
+			all += combo.weight;
+			AddCards(cardAll, combo);
+		}
+
+		double below = 0;
+		double upTo = 0;
+		std::array<double, kNumCards> cardBelow = {};
+		std::array<double, kNumCards> cardUpTo = {};
+		size_t belowCount = 0;
+		size_t upToCount = 0;
+		for (const auto& ranked : mPlayerRanks)
+		{
+			for (; belowCount < mOpponentRanks.size() && mOpponentRanks[belowCount].first < ranked.first; ++belowCount)
+			{
+				const auto& combo = mOpponentRange[mOpponentRanks[belowCount].second];
+				below += combo.weight;
+				AddCards(cardBelow, combo);
+			}
+			for (; upToCount < mOpponentRanks.size() && mOpponentRanks[upToCount].first <= ranked.first; ++upToCount)
+			{
+				const auto& combo = mOpponentRange[mOpponentRanks[upToCount].second];
+				upTo += combo.weight;
+				AddCards(cardUpTo, combo);
+			}
+
+			// the same combo in the opponent range is taken out twice, once per card, and ties with the player
+			const auto& combo = mPlayerRange[ranked.second];
+			const auto low = LowestBit(combo.cards.mask);
+			const auto high = LowestBit(combo.cards.mask & (combo.cards.mask - 1));
+			const auto sameWeight = mOpponentWeights[PreflopDatabase::HoleCardsIndex(combo.cards)];
+			const auto weight = combo.weight * tableWeight;
+
+			mChances.total += weight * (all - cardAll[low] - cardAll[high] + sameWeight);
+			mChances.winning += weight * (below - cardBelow[low] - cardBelow[high]);
+			mChances.split += weight * ((upTo - below) - (cardUpTo[low] - cardBelow[low]) - (cardUpTo[high] - cardBelow[high]) + sameWeight);
+		}
 	}
-}
 
-template <uint_fast8_t NumPlayerCards, uint_fast8_t NumOpponentCards, uint_fast8_t NumTableCards>
-void ChanceCollector<NumPlayerCards, NumOpponentCards, NumTableCards>::JoinAll()
-{
-	for (auto& threadData : mThreadData)
+	const RangeChances& GetResult() const { return mChances; }
+
+private:
+	typedef std::pair<HandRank, uint_fast16_t> RankedCombo;
+
+	static void RankLive(const HandRange& range, const HandState& tableState, std::vector<RankedCombo>& ranks)
 	{
-		while (threadData.readyToProcess.Check());
+		ranks.clear();
+		for (size_t k = 0; k < range.size(); ++k)
 		{
-			threadData.block.resize(threadData.blockFillCount);
-			threadData.readyToProcess.Raise();
+			const auto cards = range[k].cards;
+			if (cards.Intersects(tableState.cards))
+				continue;
+			const auto low = LowestBit(cards.mask);
+			const auto high = LowestBit(cards.mask & (cards.mask - 1));
+			ranks.push_back(RankedCombo(tableState.AddBit(low).AddBit(high).Rank(), static_cast<uint_fast16_t>(k)));
 		}
+		std::sort(ranks.begin(), ranks.end());
 	}
 
-	for (auto& threadData : mThreadData)
+	static void AddCards(std::array<double, kNumCards>& cardWeights, const RangeCombo& combo)
 	{
-		threadData.thread.join();
+		for (auto cards = combo.cards.mask; cards != 0; cards &= cards - 1)
+			cardWeights[LowestBit(cards)] += combo.weight;
 	}
-}
 
-template <uint_fast8_t NumPlayerCards, uint_fast8_t NumOpponentCards, uint_fast8_t NumTableCards>
-Chances ChanceCollector<NumPlayerCards, NumOpponentCards, NumTableCards>::GetResult() const
+	const HandRange& mPlayerRange;
+	const HandRange& mOpponentRange;
+	std::vector<double> mOpponentWeights;
+	std::vector<RankedCombo> mPlayerRanks;
+	std::vector<RankedCombo> mOpponentRanks;
+	RangeChances mChances;
+};
+
+// Exact weighted equity of two hold'em ranges over every completion of the table, the tables split into ranges for
+// a few pool tasks per thread
+RangeChances GetRangeChances(const HandRange& playerRange, const HandRange& opponentRange, const std::vector<Card>& tableCards)
 {
-	Chances result;
-	for (auto& threadData : mThreadData)
-		result += threadData.result;
-	return result;
+	static const uint_fast8_t kNumTableCards = 5;
+	assert(tableCards.size() <= kNumTableCards);
+
+	const CardSet knownTableCards(tableCards.data(), tableCards.size());
+	const uint_fast8_t missingTableCards = kNumTableCards - static_cast<uint_fast8_t>(tableCards.size());
+	const uint64_t deckMask = (uint64_t(1) << RangeShowdown::kNumCards) - 1;
+	const uint64_t liveMask = deckMask & ~knownTableCards.mask;
+
+	// summed in the order of the ranges, so that rounding does not depend on which task finished first
+	std::mutex resultMutex;
+	std::map<uint64_t, RangeChances> results;
+	ParallelForEachSubset(liveMask, missingTableCards, [&](uint64_t begin, uint64_t end) {
+		RangeShowdown showdown(playerRange, opponentRange);
+		auto addTable = [&](uint64_t cards) { showdown.Add(CardSet(knownTableCards.mask | cards)); };
+		ForEachSubsetInRange(liveMask, missingTableCards, begin, end, addTable);
+
+		const auto result = showdown.GetResult();
+		std::lock_guard<std::mutex> lk(resultMutex);
+		results[begin] = result;
+	});
+
+	RangeChances chances;
+	for (const auto& result : results)
+	{
+		chances += result.second;
+	}
+	return chances;
 }
 
-#define GETCHANCES_MT
-
-template <uint_fast8_t NumPlayerCards, uint_fast8_t NumOpponentCards, uint_fast8_t NumTableCards>
-Chances GetChances(const std::vector<Card>& playerCards, const std::vector<Card>& opponentCards, const std::vector<Card>& tableCards)
+// GetChances of two hold'em hands with missing cards, the tables on the outside: every table is ranked once against
+// all completions of both hands, which RangeShowdown pairs by card removal, instead of once per pair of completions.
+// Only the smallest table of every orbit under the suit permutations keeping the known cards is dealt.
+Chances GetChancesByTable(CardSet knownPlayerCards, CardSet knownOpponentCards, CardSet knownTableCards, CardSet deadCards)
 {
-	assert(playerCards.size() <= NumPlayerCards);
-	assert(opponentCards.size() <= NumOpponentCards);
-	assert(tableCards.size() <= NumTableCards);
+	static const uint_fast8_t kNumHoleCards = 2;
+	static const uint_fast8_t kNumTableCards = 5;
+	assert(knownPlayerCards.Size() <= kNumHoleCards);
+	assert(knownOpponentCards.Size() <= kNumHoleCards);
+	assert(knownTableCards.Size() <= kNumTableCards);
+
+	const uint64_t deckMask = (uint64_t(1) << RangeShowdown::kNumCards) - 1;
+	const uint64_t liveMask = deckMask & ~(knownPlayerCards | knownOpponentCards | knownTableCards | deadCards).mask;
+	const uint_fast8_t missingTableCards = kNumTableCards - knownTableCards.Size();
+
+	HandRange playerRange;
+	HandRange opponentRange;
+	auto addPlayerCombo = [&](uint64_t cards) { playerRange.push_back(RangeCombo(CardSet(knownPlayerCards.mask | cards), 1)); };
+	auto addOpponentCombo = [&](uint64_t cards) { opponentRange.push_back(RangeCombo(CardSet(knownOpponentCards.mask | cards), 1)); };
+	ForEachSubset(liveMask, kNumHoleCards - knownPlayerCards.Size(), addPlayerCombo);
+	ForEachSubset(liveMask, kNumHoleCards - knownOpponentCards.Size(), addOpponentCombo);
+
+	const auto tableSymmetry = SuitSymmetry().Stabilizer(knownPlayerCards).Stabilizer(knownOpponentCards).Stabilizer(knownTableCards).Stabilizer(deadCards);
+
+	std::mutex resultMutex;
+	RangeChances rangeChances;
+	ParallelForEachSubset(liveMask, missingTableCards, [&](uint64_t begin, uint64_t end) {
+		RangeShowdown showdown(playerRange, opponentRange);
+		auto addTable = [&](uint64_t cards) {
+			const CardSet table(knownTableCards.mask | cards);
+			const auto tableWeight = tableSymmetry.OrbitWeight(table);
+			if (tableWeight != 0)
+				showdown.Add(table, tableWeight);
+		};
+		ForEachSubsetInRange(liveMask, missingTableCards, begin, end, addTable);
 
-	constexpr auto numCardsInDeck = static_cast<int32_t>(CardColor::Count) * static_cast<int32_t>(CardValue::Count);
+		std::lock_guard<std::mutex> lk(resultMutex);
+		rangeChances += showdown.GetResult();
+	});
 
-	const int32_t numPlayerCards = playerCards.size();
-	const int32_t numOpponentCards = opponentCards.size();
-	const int32_t numTableCards = tableCards.size();
+	// every weight is 1, so the sums are exact counts
+	Chances chances;
+	chances.total = static_cast<uintmax_t>(rangeChances.total);
+	chances.winning = static_cast<uintmax_t>(rangeChances.winning);
+	chances.split = static_cast<uintmax_t>(rangeChances.split);
+	return chances;
+}
 
-	const int32_t missingPlayerCards = NumPlayerCards - numPlayerCards;
-	const int32_t missingOpponentCards = NumOpponentCards - numOpponentCards;
-	const int32_t missingTableCards = NumTableCards - numTableCards;
+// Where a hand stands against an opponent holding
+enum class Standing : uint_fast8_t
+{
+	Ahead,
+	Tied,
+	Behind,
+	Count
+};
 
-	const int32_t missingTotalCards = missingPlayerCards + missingOpponentCards + missingTableCards;
-	const int32_t knownTotalCards = NumPlayerCards + NumOpponentCards + NumTableCards - missingTotalCards;
+// Hand strength and potential of a hand against one opponent holding drawn uniformly from the live cards, as
+// defined by Billings et al.; all of them are 0 to 1
+struct HandPotential
+{
+	HandPotential() : strength(0), positive(0), negative(0), effective(0), effectiveSquared(0) {}
+
+	// the chance to be ahead now, ties counted half
+	double strength;
+	// PPot, the chance to get ahead by the river when behind now, and NPot, to fall behind when ahead
+	double positive;
+	double negative;
+	// EHS = strength * (1 - negative) + (1 - strength) * positive
+	double effective;
+	// EHS2, the mean over the runouts of the squared strength on the river
+	double effectiveSquared;
+};
 
-	Chances chances;
-	chances.total
-		= Combination(numCardsInDeck - knownTotalCards, missingPlayerCards)
-		* Combination(numCardsInDeck - knownTotalCards - missingPlayerCards, missingOpponentCards)
-		* Combination(numCardsInDeck - knownTotalCards - missingPlayerCards - missingOpponentCards, missingTableCards);
-	chances.winning = 0;
-	chances.split = 0;
-
-#ifdef GETCHANCES_MT
-	ChanceCollector<NumPlayerCards, NumOpponentCards, NumTableCards> cc(8, 512);
-	cc.Initialize();
-#endif
+// The sums behind a HandPotential, counted per runout range and then merged
+struct HandPotentialCounts
+{
+	static const uint_fast8_t kNumStandings = static_cast<uint_fast8_t>(Standing::Count);
 
-	std::array<Card, NumPlayerCards + NumTableCards> playerDeck;
-	std::array<Card, NumOpponentCards + NumTableCards> opponentDeck;
+	HandPotentialCounts() : now(), transitions(), numRunouts(0), squaredStrength(0) {}
 
-	std::array<Card, 5> bestPlayerHand;
-	std::array<Card, 5> bestOpponentHand;
+	HandPotentialCounts& operator+=(const HandPotentialCounts& c)
+	{
+		for (uint_fast8_t from = 0; from < kNumStandings; ++from)
+		{
+			now[from] += c.now[from];
+			for (uint_fast8_t to = 0; to < kNumStandings; ++to)
+				transitions[from][to] += c.transitions[from][to];
+		}
+		numRunouts += c.numRunouts;
+		squaredStrength += c.squaredStrength;
+		return *this;
+	}
 
-	std::vector<Card> knownCards(knownTotalCards);
-	std::copy(playerCards.cbegin(), playerCards.cend(), knownCards.begin());
-	std::copy(opponentCards.cbegin(), opponentCards.cend(), knownCards.begin() + numPlayerCards);
-	std::copy(tableCards.cbegin(), tableCards.cend(), knownCards.begin() + (numPlayerCards + numOpponentCards));
-	std::sort(knownCards.begin(), knownCards.end(), Card::LessWithColor);
+	// opponent holdings by standing now
+	std::array<uintmax_t, kNumStandings> now;
+	// pairs of a runout and an opponent holding, by standing now and on the river
+	std::array<std::array<uintmax_t, kNumStandings>, kNumStandings> transitions;
+	uintmax_t numRunouts;
+	// the squared river strength summed over the runouts
+	double squaredStrength;
+};
 
-	std::vector<Card> deckCards(numCardsInDeck);
-	int32_t cardGenerator = 0;
-	std::generate(deckCards.begin(), deckCards.end(), [&cardGenerator]() { return Card(cardGenerator++); });
+// HandPotential of a hand on a flop, turn or river board. The opponent holdings are ranked on the board once, then
+// every runout ranks the final board once and extends it by the hand and by each live holding, so no equity query
+// is nested in another. The runouts are all of them, one per orbit under the suit permutations keeping the hand and
+// the board in place, or numSampledRunouts random ones dealt from the given stream of seed. The tables live in the
+// arena of the constructing thread.
+class HandPotentialEnumeration
+{
+public:
+	HandPotentialEnumeration(CardSet handCards, CardSet boardCards, uint_fast32_t numSampledRunouts, uint64_t seed, uint64_t stream = 0);
 
-	std::vector<Card> playerOptions(numCardsInDeck - knownTotalCards);
-	std::vector<Card> opponentOptions(playerOptions.size() - missingPlayerCards);
-	std::vector<Card> tableOptions(opponentOptions.size() - missingOpponentCards);
-	std::set_difference(deckCards.cbegin(), deckCards.cend(), knownCards.cbegin(), knownCards.cend(), playerOptions.begin(), Card::LessWithColor);
+	size_t NumRunouts() const { return mNumRunouts; }
+	// adds the runouts [begin, end) to counts
+	void Process(size_t begin, size_t end, HandPotentialCounts& counts) const;
+	// counts also holds the standings now
+	void Initialize(HandPotentialCounts& counts) const { counts.now = mNow; }
 
-	std::vector<int_fast8_t> playerPicker(playerOptions.size());
-	std::vector<int_fast8_t> opponentPicker(opponentOptions.size());
-	std::vector<int_fast8_t> tablePicker(tableOptions.size());
+	static HandPotential GetResult(const HandPotentialCounts& counts);
 
-	std::fill(playerPicker.begin(), playerPicker.end() - missingPlayerCards, 0);
-	std::fill(playerPicker.end() - missingPlayerCards, playerPicker.end(), 1);
+private:
+	static const uint_fast8_t kNumCards = CardSet::kColorShift * static_cast<uint_fast8_t>(CardColor::Count);
+	static const uint_fast8_t kNumHoleCards = 2;
+	static const uint_fast8_t kNumBoardCards = 5;
 
-	std::array<Card, NumPlayerCards> innerPlayerCards;
-	std::copy(playerCards.cbegin(), playerCards.cend(), innerPlayerCards.begin() + NumPlayerCards - playerCards.size());
+	struct Opponent
+	{
+		uint64_t mask;
+		uint_fast8_t low;
+		uint_fast8_t high;
+		Standing now;
+	};
 
-	std::array<Card, NumOpponentCards> innerOpponentCards;
-	std::copy(opponentCards.cbegin(), opponentCards.cend(), innerOpponentCards.begin() + NumOpponentCards - opponentCards.size());
+	static Standing Compare(HandRank handRank, HandRank opponentRank)
+	{
+		return (handRank > opponentRank) ? Standing::Ahead : (handRank == opponentRank) ? Standing::Tied : Standing::Behind;
+	}
 
-	std::array<Card, NumTableCards> innerTableCards;
-	std::copy(tableCards.cbegin(), tableCards.cend(), innerTableCards.begin() + NumTableCards - tableCards.size());
+	uint_fast8_t mHandLow;
+	uint_fast8_t mHandHigh;
+	CardSet mBoardCards;
+	std::array<uintmax_t, HandPotentialCounts::kNumStandings> mNow;
+	Opponent* mOpponents;
+	size_t mNumOpponents;
+	// the missing board cards of every runout, standing for as many runouts as its weight
+	uint64_t* mRunouts;
+	uint_fast32_t* mRunoutWeights;
+	size_t mNumRunouts;
+};
 
-	uintmax_t totalTries = 0;
-	do {
-		std::vector<Card> playerKnownCards;
-		playerKnownCards.insert(playerKnownCards.end(), knownCards.begin(), knownCards.end());
+HandPotentialEnumeration::HandPotentialEnumeration(CardSet handCards, CardSet boardCards, uint_fast32_t numSampledRunouts, uint64_t seed, uint64_t stream)
+	: mHandLow(LowestBit(handCards.mask))
+	, mHandHigh(LowestBit(handCards.mask & (handCards.mask - 1)))
+	, mBoardCards(boardCards)
+	, mNow()
+	, mNumOpponents(0)
+	, mNumRunouts(0)
+{
+	assert(handCards.Size() == kNumHoleCards);
+	assert(boardCards.Size() >= 3 && boardCards.Size() <= kNumBoardCards);
+	assert(!handCards.Intersects(boardCards));
+
+	auto& arena = Arena::Local();
+	const uint64_t liveMask = ((uint64_t(1) << kNumCards) - 1) & ~(handCards | boardCards).mask;
+	const uint_fast8_t numLiveCards = PopCount(liveMask);
+	const uint_fast8_t missingBoardCards = kNumBoardCards - boardCards.Size();
+
+	const HandState boardState(boardCards);
+	const auto handRank = boardState.AddBit(mHandLow).AddBit(mHandHigh).Rank();
+	mOpponents = arena.Allocate<Opponent>(Combination(numLiveCards, kNumHoleCards));
+	auto addOpponent = [&](uint64_t cards) {
+		auto& opponent = mOpponents[mNumOpponents++];
+		opponent.mask = cards;
+		opponent.low = LowestBit(cards);
+		opponent.high = LowestBit(cards & (cards - 1));
+		opponent.now = Compare(handRank, boardState.AddBit(opponent.low).AddBit(opponent.high).Rank());
+		++mNow[static_cast<uint_fast8_t>(opponent.now)];
+	};
+	ForEachSubset(liveMask, kNumHoleCards, addOpponent);
 
-		int32_t innerPlayerCardsIndex = 0;
-		for (uint_fast32_t k = 0; k < playerOptions.size(); ++k)
+	if (numSampledRunouts > 0 && missingBoardCards > 0)
+	{
+		mRunouts = arena.Allocate<uint64_t>(numSampledRunouts);
+		mRunoutWeights = arena.Allocate<uint_fast32_t>(numSampledRunouts);
+		CardDealer dealer((CardSet(liveMask)));
+		Philox4x32 random(seed, stream);
+		for (; mNumRunouts < numSampledRunouts; ++mNumRunouts)
 		{
-			if (playerPicker[k] != 0)
-			{
-				innerPlayerCards[innerPlayerCardsIndex++] = playerOptions[k];
-				playerKnownCards.push_back(playerOptions[k]);
-			}
+			dealer.Reset();
+			mRunouts[mNumRunouts] = dealer.Deal(random, missingBoardCards).mask;
+			mRunoutWeights[mNumRunouts] = 1;
 		}
+		return;
+	}
 
-		std::sort(playerKnownCards.begin(), playerKnownCards.end(), Card::LessWithColor);
-		std::set_difference(deckCards.cbegin(), deckCards.cend(), playerKnownCards.cbegin(), playerKnownCards.cend(), opponentOptions.begin(), Card::LessWithColor);
-
-		std::fill(opponentPicker.begin(), opponentPicker.end() - missingOpponentCards, 0);
-		std::fill(opponentPicker.end() - missingOpponentCards, opponentPicker.end(), 1);
+	const auto symmetry = SuitSymmetry().Stabilizer(handCards).Stabilizer(boardCards);
+	mRunouts = arena.Allocate<uint64_t>(Combination(numLiveCards, missingBoardCards));
+	mRunoutWeights = arena.Allocate<uint_fast32_t>(Combination(numLiveCards, missingBoardCards));
+	auto addRunout = [&](uint64_t cards) {
+		const auto weight = symmetry.OrbitWeight(CardSet(boardCards.mask | cards));
+		if (weight == 0)
+			return;
+		mRunouts[mNumRunouts] = cards;
+		mRunoutWeights[mNumRunouts] = weight;
+		++mNumRunouts;
+	};
+	ForEachSubset(liveMask, missingBoardCards, addRunout);
+}
 
-		do {
-			std::vector<Card> opponentKnownCards;
-			opponentKnownCards.insert(opponentKnownCards.end(), playerKnownCards.begin(), playerKnownCards.end());
+void HandPotentialEnumeration::Process(size_t begin, size_t end, HandPotentialCounts& counts) const
+{
+	for (size_t k = begin; k < end; ++k)
+	{
+		const auto runout = mRunouts[k];
+		const auto weight = mRunoutWeights[k];
+		const HandState boardState(CardSet(mBoardCards.mask | runout));
+		const auto handRank = boardState.AddBit(mHandLow).AddBit(mHandHigh).Rank();
 
-			int32_t innerPlayerCardsIndex = 0;
-			for (uint_fast32_t k = 0; k < opponentOptions.size(); ++k)
-			{
-				if (opponentPicker[k] != 0)
-				{
-					innerOpponentCards[innerPlayerCardsIndex++] = opponentOptions[k];
-					opponentKnownCards.push_back(opponentOptions[k]);
-				}
-			}
+		std::array<uint_fast32_t, HandPotentialCounts::kNumStandings> river = {};
+		for (size_t o = 0; o < mNumOpponents; ++o)
+		{
+			const auto& opponent = mOpponents[o];
+			if ((opponent.mask & runout) != 0)
+				continue;
+			const auto standing = Compare(handRank, boardState.AddBit(opponent.low).AddBit(opponent.high).Rank());
+			counts.transitions[static_cast<uint_fast8_t>(opponent.now)][static_cast<uint_fast8_t>(standing)] += weight;
+			++river[static_cast<uint_fast8_t>(standing)];
+		}
 
-			std::sort(opponentKnownCards.begin(), opponentKnownCards.end(), Card::LessWithColor);
-			std::set_difference(deckCards.cbegin(), deckCards.cend(), opponentKnownCards.cbegin(), opponentKnownCards.cend(), tableOptions.begin(), Card::LessWithColor);
+		const auto numRiverOpponents = river[0] + river[1] + river[2];
+		const double riverStrength = (river[static_cast<uint_fast8_t>(Standing::Ahead)] + river[static_cast<uint_fast8_t>(Standing::Tied)] / 2.0) / numRiverOpponents;
+		counts.numRunouts += weight;
+		counts.squaredStrength += weight * riverStrength * riverStrength;
+	}
+}
 
-			std::fill(tablePicker.begin(), tablePicker.end() - missingTableCards, 0);
-			std::fill(tablePicker.end() - missingTableCards, tablePicker.end(), 1);
+HandPotential HandPotentialEnumeration::GetResult(const HandPotentialCounts& counts)
+{
+	const uint_fast8_t ahead = static_cast<uint_fast8_t>(Standing::Ahead);
+	const uint_fast8_t tied = static_cast<uint_fast8_t>(Standing::Tied);
+	const uint_fast8_t behind = static_cast<uint_fast8_t>(Standing::Behind);
+	const auto& t = counts.transitions;
+	auto rowTotal = [&](uint_fast8_t from) { return static_cast<double>(t[from][ahead] + t[from][tied] + t[from][behind]); };
+	auto ratio = [](double numerator, double denominator) { return (denominator > 0) ? numerator / denominator : 0; };
+
+	HandPotential potential;
+	potential.strength = ratio(counts.now[ahead] + counts.now[tied] / 2.0, static_cast<double>(counts.now[ahead] + counts.now[tied] + counts.now[behind]));
+	potential.positive = ratio(t[behind][ahead] + t[behind][tied] / 2.0 + t[tied][ahead] / 2.0, rowTotal(behind) + rowTotal(tied) / 2);
+	potential.negative = ratio(t[ahead][behind] + t[tied][behind] / 2.0 + t[ahead][tied] / 2.0, rowTotal(ahead) + rowTotal(tied) / 2);
+	potential.effective = potential.strength * (1 - potential.negative) + (1 - potential.strength) * potential.positive;
+	potential.effectiveSquared = ratio(counts.squaredStrength, static_cast<double>(counts.numRunouts));
+	return potential;
+}
 
-			do {
-				int32_t innerTableCardsIndex = 0;
-				for (uint_fast32_t k = 0; k < tableOptions.size(); ++k)
-				{
-					if (tablePicker[k] != 0)
-					{
-						innerTableCards[innerTableCardsIndex++] = tableOptions[k];
-					}
-				}
+// HandPotential of two hole cards on a board of 3 to 5 cards, exact or, when numSampledRunouts is not 0, over that
+// many random runouts. The runouts are split over the pool threads.
+HandPotential GetHandPotential(CardSet handCards, CardSet boardCards, uint_fast32_t numSampledRunouts = 0, uint64_t seed = 5489)
+{
+	const Arena::Scope arenaScope(Arena::Local());
+	const HandPotentialEnumeration enumeration(handCards, boardCards, numSampledRunouts, seed);
+
+	auto& pool = ThreadPool::Get();
+	const size_t rangeSize = MAX(enumeration.NumRunouts() / ((pool.NumThreads() + 1) * 8), size_t(1));
+	std::mutex resultMutex;
+	HandPotentialCounts counts;
+	enumeration.Initialize(counts);
+	pool.ParallelFor(enumeration.NumRunouts(), rangeSize, [&](uint64_t begin, uint64_t end) {
+		HandPotentialCounts rangeCounts;
+		enumeration.Process(static_cast<size_t>(begin), static_cast<size_t>(end), rangeCounts);
+
+		std::lock_guard<std::mutex> lk(resultMutex);
+		counts += rangeCounts;
+	});
+	return HandPotentialEnumeration::GetResult(counts);
+}
 
-#ifdef GETCHANCES_MT
-				++totalTries;
-				cc.AddTest(innerPlayerCards, innerOpponentCards, innerTableCards);
-#else
-				std::copy(innerPlayerCards.cbegin(), innerPlayerCards.cend(), playerDeck.begin());
-				std::copy(innerTableCards.cbegin(), innerTableCards.cend(), playerDeck.begin() + NumPlayerCards);
-				std::sort(playerDeck.begin(), playerDeck.end());
-				GetBestHand(playerDeck, bestPlayerHand);
+struct HandPotentialQuery
+{
+	CardSet handCards;
+	CardSet boardCards;
+};
 
-				std::copy(innerOpponentCards.cbegin(), innerOpponentCards.cend(), opponentDeck.begin());
-				std::copy(innerTableCards.cbegin(), innerTableCards.cend(), opponentDeck.begin() + NumOpponentCards);
-				std::sort(opponentDeck.begin(), opponentDeck.end());
-				GetBestHand(opponentDeck, bestOpponentHand);
+// HandPotential of many spots, each computed whole by one pool task, which beats splitting single spots once there
+// are more spots than threads. Sampled spot k uses stream k of seed, so the results do not depend on the number of
+// threads.
+std::vector<HandPotential> GetHandPotentials(const std::vector<HandPotentialQuery>& queries, uint_fast32_t numSampledRunouts = 0, uint64_t seed = 5489)
+{
+	auto& pool = ThreadPool::Get();
+	const size_t rangeSize = MAX(queries.size() / ((pool.NumThreads() + 1) * 16), size_t(1));
+	std::vector<HandPotential> results(queries.size());
+	pool.ParallelFor(queries.size(), rangeSize, [&](uint64_t begin, uint64_t end) {
+		for (auto k = begin; k < end; ++k)
+		{
+			const Arena::Scope arenaScope(Arena::Local());
+			const HandPotentialEnumeration enumeration(queries[k].handCards, queries[k].boardCards, numSampledRunouts, seed, k);
+			HandPotentialCounts counts;
+			enumeration.Initialize(counts);
+			enumeration.Process(0, enumeration.NumRunouts(), counts);
+			results[k] = HandPotentialEnumeration::GetResult(counts);
+		}
+	});
+	return results;
+}
 
-				++totalTries;
-				const auto comparisonResult = CompareHands(&bestPlayerHand[0], &bestOpponentHand[0]);
-				chances.winning += (comparisonResult == 1) ? 1 : 0;
-				chances.split += (comparisonResult == 0) ? 1 : 0;
+// Checks the unrolled GetBestHand walk against GetHandRank on random deals of NumDeckCards cards. GetHandRank
+// ranks 5 to 7 cards, so bigger deals expect the best rank among their 7-card subsets.
+template <uint_fast8_t NumDeckCards>
+bool CheckBestHands(uint_fast32_t numDeals, uint64_t seed)
+{
+	static const uint_fast8_t kNumRankedCards = MIN(NumDeckCards, 7);
 
-				//if (comparisonResult == 0)
-				//{
-				//	printf("Hand type: %13s Hand: %s\n", ToString(GetHandType(&bestPlayerHand[0])).c_str(), ToString(&playerDeck[0], 7).c_str());
-				//	printf("Hand type: %13s Hand: %s\n", ToString(GetHandType(&bestOpponentHand[0])).c_str(), ToString(&opponentDeck[0], 7).c_str());
-				//	printf("comparisonResult: %d\n", comparisonResult);
-				//}
-#endif // #ifdef GETCHANCES_MT
+	Philox4x32 random(seed, NumDeckCards);
+	CardDealer dealer(CardSet((uint64_t(1) << CardDealer::kNumCards) - 1));
+	for (uint_fast32_t deal = 0; deal < numDeals; ++deal)
+	{
+		dealer.Reset();
+		std::array<Card, NumDeckCards> cards;
+		for (auto& card : cards)
+			card = CardSet::BitCard(dealer.DealBit(random));
+		std::sort(cards.begin(), cards.end());
+
+		std::array<Card, 5> bestHand;
+		GetBestHand<NumDeckCards>(cards, bestHand);
+
+		const CardSet dealtCards(&cards[0], NumDeckCards);
+		HandRank expectedRank = 0;
+		for (uint64_t subset = dealtCards.mask; subset != 0; subset = (subset - 1) & dealtCards.mask)
+		{
+			if (PopCount(subset) == kNumRankedCards)
+				expectedRank = MAX(expectedRank, GetHandRank(CardSet(subset)));
+		}
 
-			} while (std::next_permutation(tablePicker.begin(), tablePicker.end()));
+		const CardSet bestCards(&bestHand[0], bestHand.size());
+		if (bestCards.Size() != bestHand.size() || (bestCards.mask & ~dealtCards.mask) != 0 || GetHandRank(bestCards) != expectedRank)
+		{
+			printf("GetBestHand<%u>: %s picked %s\n", static_cast<unsigned>(NumDeckCards), ToString(&cards[0], NumDeckCards).c_str(),
+				ToString(&bestHand[0], 5).c_str());
+			return false;
+		}
+	}
+	return true;
+}
 
-		} while (std::next_permutation(opponentPicker.begin(), opponentPicker.end()));
+// Every size the subset tables are generated for.
+bool CheckBestHands()
+{
+	static const uint_fast32_t kNumDeals = 10000;
 
-	} while (std::next_permutation(playerPicker.begin(), playerPicker.end()));
+	return CheckBestHands<5>(kNumDeals, 5489) && CheckBestHands<6>(kNumDeals, 5489) && CheckBestHands<7>(kNumDeals, 5489)
+		&& CheckBestHands<8>(kNumDeals, 5489) && CheckBestHands<9>(kNumDeals, 5489);
+}
 
-	printf("totalTries=%llu\n", totalTries);
+#ifdef COUNT_ALLOCATIONS
+// Repeats equity queries after a warm-up round, which may build tables, start the pool and grow the arenas, and
+// fails when the repeated rounds allocate.
+bool CheckSteadyStateAllocations()
+{
+	static const uint_fast32_t kNumRounds = 5;
 
-#ifdef GETCHANCES_MT
-	cc.JoinAll();
+	const std::vector<Card> playerCards = {"Ah", "Kh"};
+	const std::vector<Card> opponentCards = {"Qs", "Js"};
+	const std::vector<Card> tableCards = {};
 
-	return cc.GetResult();
-#endif
+	uint64_t numAllocations = 0;
+	Chronometer ch(false);
+	for (uint_fast32_t round = 0; round <= kNumRounds; ++round)
+	{
+		if (round == 1)
+		{
+			numAllocations = gNumAllocations.load();
+			ch.Start();
+		}
+		GetChances<2, 2, 5>(playerCards, opponentCards, tableCards);
+		SampleChances<2, 2, 5>(playerCards, opponentCards, tableCards, {}, 0.001, 1000000);
+	}
+	numAllocations = gNumAllocations.load() - numAllocations;
 
-	return chances;
+	printf("Steady state: %f ms per round, %llu allocations in %u rounds\n", ch.GetElapsedTimeMs() / kNumRounds,
+		static_cast<unsigned long long>(numAllocations), static_cast<unsigned>(kNumRounds));
+	return numAllocations == 0;
 }
+#endif
 
 void main()
 {
@@ -2066,7 +4676,7 @@ void main()
 #endif
 
 #if 0
-	srand(GetTickCount());
+	SeedDealing(GetTickCount());
 
 	float fWin, fDraw, ifWin, ifDraw;
 	byte hand[2] = { 45, 43 };
@@ -2101,11 +4711,20 @@ void main()
 #endif
 
 #if 1
-	//std::vector<Card> cards = {"Ks", "Qs", "Js", "0s", "As", "Ah", "Ad"};
-	//std::sort(cards.begin(), cards.end());
-	//printf("Cards: %s\n", ToString(&cards[0], 7).c_str());
-	//const auto& bestHand = GetBestHand(cards);
-	//printf("Hand type: %s Hand: %s\n", ToString(GetHandType(&bestHand[0])).c_str(), ToString(&bestHand[0], 5).c_str());
+	if (!CheckBestHands())
+		exit(EXIT_FAILURE);
+
+	std::array<Card, 7> cards = { {"Ks", "Qs", "Js", "0s", "As", "Ah", "Ad"} };
+	std::sort(cards.begin(), cards.end());
+	printf("Cards: %s\n", ToString(&cards[0], 7).c_str());
+	std::array<Card, 5> bestHand;
+	GetBestHand<7>(cards, bestHand);
+	printf("Hand type: %s Hand: %s\n", ToString(GetHandType(&bestHand[0])).c_str(), ToString(&bestHand[0], 5).c_str());
+
+#ifdef COUNT_ALLOCATIONS
+	if (!CheckSteadyStateAllocations())
+		exit(EXIT_FAILURE);
+#endif
 
 	Chronometer ch(true);
 	const auto& chances = GetChances<2, 2, 5>({"Kh"}, {"Ah"}, {"4d", "5h"});